@@ -13,11 +13,24 @@
 #include <linux/input.h>
 #include <linux/spi/spi.h>
 #include <linux/device.h>
+#include <linux/of.h>
 #include <linux/init.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/sched/prio.h>
+#include <linux/sched/task_stack.h>
+#include <uapi/linux/sched/types.h>
+#include <linux/log2.h>
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/slab.h>
+#include <linux/regmap.h>
 #include <linux/gpio.h>
 #include <linux/sched.h>
 #include <linux/uaccess.h>
@@ -25,6 +38,7 @@
 #include <linux/pm_qos.h>
 #include <linux/sysfs.h>
 #include <linux/clk.h>
+#include <asm/unaligned.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -38,26 +52,407 @@
 
 #define DRV_NAME "rt5514-spi"
 
-static struct spi_device *rt5514_spi;
-static struct mutex spi_lock;
+struct rt5514_spi_batch {
+	struct spi_message message;
+	struct spi_transfer x[RT5514_SPI_MSG_CHUNKS * 3];
+	struct completion done;
+	ktime_t start, end;
+	u8 *rxbuf;
+	size_t len;
+	/* Ends inside a cache line that the next batch receives into */
+	bool tail_shared;
+	u8 cmd_buf[RT5514_SPI_MSG_CHUNKS * 8] ____cacheline_aligned;
+};
+
+/* Transfer buffers allocated once at probe, DMA-safe and reused per call */
+struct rt5514_spi_bufs {
+	struct rt5514_spi_batch batch[2];
+	u8 reg_tx[10] ____cacheline_aligned;
+	u8 reg_rx[4] ____cacheline_aligned;
+	u8 reg_rx_multi[RT5514_SPI_MSG_CHUNKS * 4] ____cacheline_aligned;
+	u8 rmw[8] ____cacheline_aligned;
+};
+
+static const char * const rt5514_spi_class_name[RT5514_SPI_CLASS_NUM] = {
+	"stream", "firmware", "control", "debug",
+};
+
+/* Latency histogram bins: <1us, then [2^(n-1), 2^n) us, the last is open */
+#define RT5514_SPI_LAT_BINS		16
+
+struct rt5514_spi_stats {
+	u64 messages, bytes_read, bytes_written, errors, retries;
+	u32 latency[RT5514_SPI_CLASS_NUM][RT5514_SPI_LAT_BINS];
+};
+
+/*
+ * Ring descriptors of all streams, cached in one snapshot. The registers
+ * cannot be burst read, but their single reads are packed into one message.
+ */
+static const unsigned int rt5514_ring_regs[] = {
+	RT5514_BUFFER_VOICE_BASE, RT5514_BUFFER_VOICE_LIMIT,
+	RT5514_BUFFER_VOICE_WP,
+	RT5514_BUFFER_MUSIC_BASE, RT5514_BUFFER_MUSIC_LIMIT,
+	RT5514_BUFFER_MUSIC_WP,
+	RT5514_BUFFER_ADC_BASE, RT5514_BUFFER_ADC_LIMIT,
+	RT5514_BUFFER_ADC_WP,
+};
+
+/* How long a ring snapshot may be reused by the copy works */
+#define RT5514_RING_SNAPSHOT_US		2000
+
+/*
+ * Copy work polling: retry after a bad read, pace while the PCM buffer is
+ * full, wakeup slack
+ */
+#define RT5514_POLL_RETRY_NS		(50 * NSEC_PER_MSEC)
+#define RT5514_POLL_PACE_NS		(10 * NSEC_PER_MSEC)
+#define RT5514_POLL_SLACK_NS		(2 * NSEC_PER_MSEC)
+
+/* DSP ring of a PCM stream, indexed by the id of its CPU DAI */
+struct rt5514_stream_desc {
+	unsigned int base_addr, limit_addr, wp_addr;
+	/* IRQ flag that starts the stream, 0 if hw_params starts it */
+	unsigned int irq_flag;
+	unsigned int stream_flag;
+	/* Sample rate of the 16-bit mono ring, as on its CPU DAI */
+	unsigned int rate;
+	/* Pre-roll bytes skipped per ms of ignore_ms_prop */
+	unsigned int ignore_bytes_per_ms;
+	const char *ignore_ms_prop;
+	/* Hold the SPI bus during the pre-roll drain in bus lock mode */
+	bool preroll_bus_lock;
+	/* Can stream live from hw_params instead, ignoring its IRQ flag */
+	bool continuous;
+	const char *continuous_prop;
+};
+
+static const struct rt5514_stream_desc rt5514_stream_descs[] = {
+	{
+		.base_addr = RT5514_BUFFER_VOICE_BASE,
+		.limit_addr = RT5514_BUFFER_VOICE_LIMIT,
+		.wp_addr = RT5514_BUFFER_VOICE_WP,
+		.irq_flag = RT5514_DSP_HOTWORD,
+		.stream_flag = RT5514_DSP_STREAM_HOTWORD,
+		.rate = 16000,
+		.ignore_bytes_per_ms = 32,
+		.ignore_ms_prop = "realtek,hotword-ignore-ms",
+		.preroll_bus_lock = true,
+		.continuous = true,
+		.continuous_prop = "realtek,hotword-continuous",
+	},
+	{
+		.base_addr = RT5514_BUFFER_MUSIC_BASE,
+		.limit_addr = RT5514_BUFFER_MUSIC_LIMIT,
+		.wp_addr = RT5514_BUFFER_MUSIC_WP,
+		.irq_flag = RT5514_DSP_MUSDET,
+		.stream_flag = RT5514_DSP_STREAM_MUSDET,
+		.rate = 16000,
+		.ignore_bytes_per_ms = 16,
+		.ignore_ms_prop = "realtek,musdet-ignore-ms",
+	},
+	{
+		.base_addr = RT5514_BUFFER_ADC_BASE,
+		.limit_addr = RT5514_BUFFER_ADC_LIMIT,
+		.wp_addr = RT5514_BUFFER_ADC_WP,
+		.stream_flag = RT5514_DSP_STREAM_ADC,
+		.rate = 8000,
+	},
+	{
+		.base_addr = RT5514_BUFFER_MUSIC_BASE,
+		.limit_addr = RT5514_BUFFER_MUSIC_LIMIT,
+		.wp_addr = RT5514_BUFFER_MUSIC_WP,
+		.irq_flag = RT5514_DSP_MUSDET_BREAK,
+		.stream_flag = RT5514_DSP_STREAM_MUSDET_BRK,
+		.rate = 16000,
+		.ignore_bytes_per_ms = 16,
+		.ignore_ms_prop = "realtek,musdet-brk-ignore-ms",
+	},
+};
+
+#define RT5514_STREAM_NUM		ARRAY_SIZE(rt5514_stream_descs)
+
+/* State of a PCM stream and of the copy work draining its DSP ring */
+struct rt5514_stream {
+	const struct rt5514_stream_desc *desc;
+	struct rt5514_dsp *dsp;
+	unsigned int id;
+	struct snd_pcm_substream *substream;
+	struct kthread_delayed_work copy_work;
+	/* Starts a stream that does not wait for a DSP event */
+	struct delayed_work arm_work;
+	/* Streams live from hw_params, ignoring DSP events */
+	bool continuous;
+	/* Stream continuously from the next hw_params on */
+	bool continuous_req;
+	/* Runs the copy work, so polling does not round to jiffies */
+	struct hrtimer poll_timer;
+	unsigned int buf_base, buf_limit, buf_rp;
+	unsigned int stream_flag;
+	unsigned int ignore_ms;
+	size_t buf_size, get_size, dma_offset;
+	/* Unread bytes in the ring at the last write pointer look */
+	size_t left;
+	ktime_t wp_stamp;
+	unsigned int overruns;
+	/* Fill watermark the copy work waits for, 0 if it is not waiting */
+	size_t wm_bytes;
+};
+
+/* Whether the firmware raises fill watermark interrupts */
+enum rt5514_wm_state {
+	RT5514_WM_UNKNOWN,
+	RT5514_WM_SUPPORTED,
+	RT5514_WM_UNSUPPORTED,
+};
 
-struct rt5514_dsp *g_rt5514_dsp;
+/* All bound SPI devices, looked up by the codec driver at probe */
+static LIST_HEAD(rt5514_dsp_list);
+static DEFINE_MUTEX(rt5514_dsp_list_lock);
 
 struct rt5514_dsp {
 	struct device *dev;
-	struct delayed_work start_work, adc_work, copy_work_0, copy_work_1,
-		copy_work_2, copy_work_3;
+	struct spi_device *spi;
+	struct list_head list;
+	struct rt5514_priv *codec;
+	struct mutex spi_lock;
+	struct rt5514_spi_bufs *bufs;
+	u8 *tx_buf;
+	size_t buf_len;
+	unsigned int msg_chunks;
+	unsigned int reg_chunks;
+	u32 sram_speed_hz, reg_speed_hz;
+	struct regmap *regmap;
+	bool bus_lock_mode;
+	bool long_burst;
+	bool wm_mode;
+	bool overrun_xrun;
+	/* Watermark mailbox, feature_id bits and IRQ_FLAG bit of the firmware */
+	u32 wm_mailbox, wm_feature, wm_irq;
+	enum rt5514_wm_state wm_state;
+	struct task_struct *bus_owner;
+	atomic_t stream_waiters;
+	wait_queue_head_t stream_wq;
+	enum rt5514_spi_class cur_class;
+	spinlock_t stats_lock;
+	struct rt5514_spi_stats stats;
+	struct dentry *debugfs;
+	struct mutex ring_lock;
+	unsigned int ring_snapshot[ARRAY_SIZE(rt5514_ring_regs)];
+	ktime_t ring_stamp[ARRAY_SIZE(rt5514_ring_regs)];
+	/* Bitmap of the ring_snapshot entries read successfully */
+	unsigned long ring_valid;
+	/* Runs the copy works only, starting streams goes to system_wq */
+	struct kthread_worker *worker;
+	struct delayed_work start_work;
 	struct mutex dma_lock;
-	struct snd_pcm_substream *substream[RT5514_DSP_STREAM_NUM];
+	struct rt5514_stream stream[RT5514_STREAM_NUM];
 	struct snd_soc_component *component;
-	unsigned int buf_base[RT5514_DSP_STREAM_NUM], buf_limit[RT5514_DSP_STREAM_NUM],
-		buf_rp[RT5514_DSP_STREAM_NUM], buf_rp_addr[RT5514_DSP_STREAM_NUM];
-	unsigned int stream_flag[RT5514_DSP_STREAM_NUM];
-	unsigned int hotword_ignore_ms, musdet_ignore_ms, musdet_brk_ignore_ms;
-	size_t buf_size[RT5514_DSP_STREAM_NUM], get_size[RT5514_DSP_STREAM_NUM],
-		dma_offset[RT5514_DSP_STREAM_NUM];
+	bool pcm_dma_buffer;
 };
 
+static bool rt5514_spi_bus_owned(struct rt5514_dsp *rt5514_dsp)
+{
+	return READ_ONCE(rt5514_dsp->bus_owner) == current;
+}
+
+static void rt5514_spi_lock(struct rt5514_dsp *rt5514_dsp,
+	enum rt5514_spi_class class)
+{
+	if (!rt5514_spi_bus_owned(rt5514_dsp))
+		mutex_lock(&rt5514_dsp->spi_lock);
+
+	rt5514_dsp->cur_class = class;
+}
+
+static void rt5514_spi_unlock(struct rt5514_dsp *rt5514_dsp)
+{
+	if (!rt5514_spi_bus_owned(rt5514_dsp))
+		mutex_unlock(&rt5514_dsp->spi_lock);
+}
+
+/*
+ * Stream readers announce themselves before waiting for spi_lock. Bulk
+ * transfers check for them between chunks and step aside, so a firmware
+ * upload or a memory test holds off the ring readers for one chunk at most.
+ */
+static void rt5514_spi_lock_stream(struct rt5514_dsp *rt5514_dsp)
+{
+	if (rt5514_spi_bus_owned(rt5514_dsp)) {
+		rt5514_dsp->cur_class = RT5514_SPI_CLASS_STREAM;
+		return;
+	}
+
+	atomic_inc(&rt5514_dsp->stream_waiters);
+	mutex_lock(&rt5514_dsp->spi_lock);
+	if (atomic_dec_and_test(&rt5514_dsp->stream_waiters))
+		wake_up_all(&rt5514_dsp->stream_wq);
+
+	rt5514_dsp->cur_class = RT5514_SPI_CLASS_STREAM;
+}
+
+/*
+ * Take spi_lock and the SPI bus lock together, so no other device on the
+ * controller can get messages in between ours until rt5514_spi_bus_unlock().
+ * The transfer functions called by the owner task skip spi_lock and use the
+ * _locked SPI calls. spi_lock is taken as a stream reader, so a bulk
+ * transfer holding it steps aside after its current chunk. Both locks are
+ * mutexes, so they must be released by the same task within one work
+ * iteration.
+ */
+static void rt5514_spi_bus_lock(struct rt5514_dsp *rt5514_dsp)
+{
+	rt5514_spi_lock_stream(rt5514_dsp);
+	spi_bus_lock(rt5514_dsp->spi->master);
+	WRITE_ONCE(rt5514_dsp->bus_owner, current);
+}
+
+static void rt5514_spi_bus_unlock(struct rt5514_dsp *rt5514_dsp)
+{
+	WRITE_ONCE(rt5514_dsp->bus_owner, NULL);
+	spi_bus_unlock(rt5514_dsp->spi->master);
+	mutex_unlock(&rt5514_dsp->spi_lock);
+}
+
+/*
+ * Drop spi_lock while stream readers are waiting for it. Returns true if
+ * the lock was dropped, so the caller knows the shared buffers may have
+ * been used in between.
+ */
+static bool rt5514_spi_yield(struct rt5514_dsp *rt5514_dsp)
+{
+	enum rt5514_spi_class class = rt5514_dsp->cur_class;
+
+	if (!atomic_read(&rt5514_dsp->stream_waiters) ||
+		rt5514_spi_bus_owned(rt5514_dsp))
+		return false;
+
+	mutex_unlock(&rt5514_dsp->spi_lock);
+	wait_event(rt5514_dsp->stream_wq,
+		!atomic_read(&rt5514_dsp->stream_waiters));
+	mutex_lock(&rt5514_dsp->spi_lock);
+
+	rt5514_dsp->cur_class = class;
+
+	return true;
+}
+
+static int rt5514_spi_read_range(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, u8 *rxbuf, size_t len, enum rt5514_spi_class class,
+	size_t *done);
+
+static int __rt5514_spi_read_multi(struct rt5514_dsp *rt5514_dsp,
+	const unsigned int *addrs, unsigned int *vals, unsigned int num);
+static int rt5514_spi_stream_reg_read(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, unsigned int *val);
+static int rt5514_spi_stream_reg_write(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, unsigned int val);
+
+/* Read the DSP ring for a PCM stream. Returns true for success. */
+static bool rt5514_spi_stream_read(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, u8 *rxbuf, size_t len)
+{
+	return !rt5514_spi_read_range(rt5514_dsp, addr, rxbuf, len,
+		RT5514_SPI_CLASS_STREAM, NULL);
+}
+
+static int rt5514_spi_ring_index(unsigned int addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(rt5514_ring_regs); i++) {
+		if (rt5514_ring_regs[i] == addr)
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+static bool rt5514_spi_ring_fresh(struct rt5514_dsp *rt5514_dsp,
+	unsigned int i, ktime_t now)
+{
+	return test_bit(i, &rt5514_dsp->ring_valid) &&
+		ktime_us_delta(now, rt5514_dsp->ring_stamp[i]) <=
+		RT5514_RING_SNAPSHOT_US;
+}
+
+/*
+ * Look up ring descriptor registers in the ring snapshot. Registers older
+ * than RT5514_RING_SNAPSHOT_US, or all of @addrs when @refresh is set, are
+ * read again with one message. The stale write pointers of the other open
+ * streams ride along in it, so the copy works of concurrently running
+ * streams share one read per tick, while the rings of closed streams are
+ * not read at all. A write pointer from the snapshot may lag the DSP a
+ * little, which only delays data.
+ */
+static int rt5514_spi_ring_read(struct rt5514_dsp *rt5514_dsp,
+	const unsigned int *addrs, unsigned int *vals, unsigned int num,
+	bool refresh)
+{
+	unsigned int regs[ARRAY_SIZE(rt5514_ring_regs)];
+	unsigned int snap[ARRAY_SIZE(rt5514_ring_regs)];
+	unsigned char idx[ARRAY_SIZE(rt5514_ring_regs)];
+	unsigned long stale = 0;
+	unsigned int i, n = 0;
+	ktime_t now;
+	int j, ret = 0;
+
+	mutex_lock(&rt5514_dsp->ring_lock);
+
+	now = ktime_get();
+	for (i = 0; i < num; i++) {
+		j = rt5514_spi_ring_index(addrs[i]);
+		if (j < 0) {
+			ret = j;
+			goto unlock;
+		}
+
+		if (refresh || !rt5514_spi_ring_fresh(rt5514_dsp, j, now))
+			__set_bit(j, &stale);
+	}
+
+	if (stale) {
+		for (i = 0; i < RT5514_STREAM_NUM; i++) {
+			if (!READ_ONCE(rt5514_dsp->stream[i].substream))
+				continue;
+
+			j = rt5514_spi_ring_index(
+				rt5514_dsp->stream[i].desc->wp_addr);
+			if (!rt5514_spi_ring_fresh(rt5514_dsp, j, now))
+				__set_bit(j, &stale);
+		}
+
+		for_each_set_bit(j, &stale, ARRAY_SIZE(rt5514_ring_regs)) {
+			regs[n] = rt5514_ring_regs[j];
+			idx[n++] = j;
+		}
+
+		rt5514_spi_lock_stream(rt5514_dsp);
+		ret = __rt5514_spi_read_multi(rt5514_dsp, regs, snap, n);
+		rt5514_spi_unlock(rt5514_dsp);
+
+		if (ret) {
+			rt5514_dsp->ring_valid &= ~stale;
+			goto unlock;
+		}
+
+		for (i = 0; i < n; i++) {
+			rt5514_dsp->ring_snapshot[idx[i]] = snap[i];
+			rt5514_dsp->ring_stamp[idx[i]] = now;
+		}
+		rt5514_dsp->ring_valid |= stale;
+	}
+
+	for (i = 0; i < num; i++)
+		vals[i] = rt5514_dsp->ring_snapshot[
+			rt5514_spi_ring_index(addrs[i])];
+
+unlock:
+	mutex_unlock(&rt5514_dsp->ring_lock);
+
+	return ret;
+}
+
 static const struct snd_pcm_hardware rt5514_spi_pcm_hardware = {
 	.info			= SNDRV_PCM_INFO_MMAP |
 				  SNDRV_PCM_INFO_MMAP_VALID |
@@ -183,664 +578,700 @@ static const unsigned int rt5514_regdump_table2[] = {
 	0x18002fe4, 0x18002fe8, 0x18002fec, 0x18002ff0, 0x18002ff4,
 };
 
-static bool rt5514_watchdog_dbg_info(struct rt5514_dsp *rt5514_dsp)
+/* Called with rt5514_dsp_list_lock held, which keeps @codec bound */
+static bool rt5514_watchdog_dbg_info(struct rt5514_dsp *rt5514_dsp,
+	struct rt5514_priv *codec)
 {
+	struct regmap *i2c_regmap = codec->i2c_regmap;
 	RT5514_DBGBUF_MEM dbgbuf;
 	unsigned int i, val[5], ret;
 
-	ret = regmap_read(rt5514_g_i2c_regmap, 0x18002f04, &val[0]);
+	ret = rt5514_spi_stream_reg_read(rt5514_dsp, 0x18002f04, &val[0]);
 	if (ret) {
 		dev_err(rt5514_dsp->dev,
-			"Failed to i2c read %d\n", ret);
+			"Failed to spi read %d\n", ret);
 		return true;
 	}
 
 	if (!(val[0] & 0x2))
 		return false;
 
-	regmap_read(rt5514_g_i2c_regmap, 0x18002ff0, &val[0]);
+	regmap_read(i2c_regmap, 0x18002ff0, &val[0]);
 	if (val[0] == 0x80)
 		val[1] = 0x4fe00000;
 	else
 		val[1] = 0x4ff60000;
 
-	rt5514_spi_burst_read(val[1], (u8 *)&dbgbuf, RT5514_DBG_BUF_SIZE);
+	rt5514_spi_read_range(rt5514_dsp, val[1], (u8 *)&dbgbuf,
+		RT5514_DBG_BUF_SIZE, RT5514_SPI_CLASS_DBG, NULL);
 
 	dev_err(rt5514_dsp->dev, "[DSP Dump]");
 	for (i = 0; i < RT5514_DBG_BUF_CNT; i++)
-		dev_err(&rt5514_spi->dev, "[%02x][%06x][%08x]\n",
+		dev_err(rt5514_dsp->dev, "[%02x][%06x][%08x]\n",
 			dbgbuf.unit[i].id, dbgbuf.unit[i].ts, dbgbuf.unit[i].val);
 	dev_err(rt5514_dsp->dev, "[%08x][%08x]\n",
 		dbgbuf.reserve, dbgbuf.idx);
 
 	dev_err(rt5514_dsp->dev, "[Reg Dump]");
 	for (i = 0; i < ARRAY_SIZE(rt5514_regdump_table1); i+=5) {
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i], &val[0]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 1], &val[1]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 2], &val[2]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 3], &val[3]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 4], &val[4]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i], &val[0]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 1], &val[1]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 2], &val[2]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 3], &val[3]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 4], &val[4]);
 		dev_err(rt5514_dsp->dev, "[%08x][%08x][%08x][%08x][%08x]",
 			val[0], val[1], val[2], val[3], val[4]);
 	}
 
 	dev_err(rt5514_dsp->dev, "==================================================");
 
-	regmap_write(rt5514_g_i2c_regmap, 0xfafafafa, 0x00000001);
+	regmap_write(i2c_regmap, 0xfafafafa, 0x00000001);
 	for (i = 0; i < ARRAY_SIZE(rt5514_regdump_table2); i+=5) {
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i], &val[0]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 1], &val[1]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 2], &val[2]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 3], &val[3]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 4], &val[4]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i], &val[0]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 1], &val[1]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 2], &val[2]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 3], &val[3]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 4], &val[4]);
 		dev_err(rt5514_dsp->dev, "[%08x][%08x][%08x][%08x][%08x]",
 			val[0], val[1], val[2], val[3], val[4]);
 	}
-	regmap_write(rt5514_g_i2c_regmap, 0xfafafafa, 0x00000000);
+	regmap_write(i2c_regmap, 0xfafafafa, 0x00000000);
 
 	return true;
 }
 
-bool rt5514_dump_dbg_info(void)
+bool rt5514_dump_dbg_info(struct rt5514_dsp *rt5514_dsp)
 {
-	struct rt5514_dsp *rt5514_dsp = g_rt5514_dsp;
+	struct regmap *i2c_regmap = rt5514_dsp->codec->i2c_regmap;
 	RT5514_DBGBUF_MEM dbgbuf;
 	unsigned int i, val[5];
 
-	regmap_read(rt5514_g_i2c_regmap, 0x18002ff0, &val[0]);
+	regmap_read(i2c_regmap, 0x18002ff0, &val[0]);
 	if (val[0] == 0x80)
 		val[1] = 0x4fe00000;
 	else
 		val[1] = 0x4ff60000;
 
-	rt5514_spi_burst_read(val[1], (u8 *)&dbgbuf, RT5514_DBG_BUF_SIZE);
+	rt5514_spi_read_range(rt5514_dsp, val[1], (u8 *)&dbgbuf,
+		RT5514_DBG_BUF_SIZE, RT5514_SPI_CLASS_DBG, NULL);
 
 	dev_err(rt5514_dsp->dev, "[DSP Dump]");
 	for (i = 0; i < RT5514_DBG_BUF_CNT; i++)
-		dev_err(&rt5514_spi->dev, "[%02x][%06x][%08x]\n",
+		dev_err(rt5514_dsp->dev, "[%02x][%06x][%08x]\n",
 			dbgbuf.unit[i].id, dbgbuf.unit[i].ts, dbgbuf.unit[i].val);
 	dev_err(rt5514_dsp->dev, "[%08x][%08x]\n",
 		dbgbuf.reserve, dbgbuf.idx);
 
 	for (i = 0; i < (RT5514_DBG_BUF_SIZE/4); i++)
-		regmap_read(rt5514_g_i2c_regmap, val[1]+(i*4), ((unsigned int *)&dbgbuf) + i);
+		regmap_read(i2c_regmap, val[1]+(i*4), ((unsigned int *)&dbgbuf) + i);
 
 	dev_err(rt5514_dsp->dev, "[DSP Dump]");
 	for (i = 0; i < RT5514_DBG_BUF_CNT; i++)
-		dev_err(&rt5514_spi->dev, "[%02x][%06x][%08x]\n",
+		dev_err(rt5514_dsp->dev, "[%02x][%06x][%08x]\n",
 			dbgbuf.unit[i].id, dbgbuf.unit[i].ts, dbgbuf.unit[i].val);
 	dev_err(rt5514_dsp->dev, "[%08x][%08x]\n",
 		dbgbuf.reserve, dbgbuf.idx);
 
 	dev_err(rt5514_dsp->dev, "[Reg Dump]");
 	for (i = 0; i < ARRAY_SIZE(rt5514_regdump_table1); i+=5) {
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i], &val[0]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 1], &val[1]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 2], &val[2]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 3], &val[3]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table1[i + 4], &val[4]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i], &val[0]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 1], &val[1]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 2], &val[2]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 3], &val[3]);
+		regmap_read(i2c_regmap, rt5514_regdump_table1[i + 4], &val[4]);
 		dev_err(rt5514_dsp->dev, "[%08x][%08x][%08x][%08x][%08x]",
 			val[0], val[1], val[2], val[3], val[4]);
 	}
 
 	dev_err(rt5514_dsp->dev, "==================================================");
 
-	regmap_write(rt5514_g_i2c_regmap, 0xfafafafa, 0x00000001);
+	regmap_write(i2c_regmap, 0xfafafafa, 0x00000001);
 	for (i = 0; i < ARRAY_SIZE(rt5514_regdump_table2); i+=5) {
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i], &val[0]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 1], &val[1]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 2], &val[2]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 3], &val[3]);
-		regmap_read(rt5514_g_i2c_regmap, rt5514_regdump_table2[i + 4], &val[4]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i], &val[0]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 1], &val[1]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 2], &val[2]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 3], &val[3]);
+		regmap_read(i2c_regmap, rt5514_regdump_table2[i + 4], &val[4]);
 		dev_err(rt5514_dsp->dev, "[%08x][%08x][%08x][%08x][%08x]",
 			val[0], val[1], val[2], val[3], val[4]);
 	}
-	regmap_write(rt5514_g_i2c_regmap, 0xfafafafa, 0x00000000);
+	regmap_write(i2c_regmap, 0xfafafafa, 0x00000000);
 
 	return true;
 }
 EXPORT_SYMBOL_GPL(rt5514_dump_dbg_info);
 
-static void rt5514_spi_copy_work_0(struct work_struct *work)
+static enum hrtimer_restart rt5514_spi_poll_timer(struct hrtimer *timer)
 {
-	struct rt5514_dsp *rt5514_dsp =
-		container_of(work, struct rt5514_dsp, copy_work_0.work);
-	struct snd_pcm_runtime *runtime;
-	size_t period_bytes, truncated_bytes = 0;
-	unsigned int cur_wp, remain_data;
-	u8 buf[8];
-
-	mutex_lock(&rt5514_dsp->dma_lock);
-	if (!rt5514_dsp->substream[0]) {
-		dev_err(rt5514_dsp->dev, "No pcm0 substream\n");
-		goto done;
-	}
-
-	runtime = rt5514_dsp->substream[0]->runtime;
-	period_bytes = snd_pcm_lib_period_bytes(rt5514_dsp->substream[0]);
-	if (!period_bytes) {
-		schedule_delayed_work(&rt5514_dsp->copy_work_0,
-			msecs_to_jiffies(50));
-		goto done;
-	}
-
-	if (rt5514_dsp->buf_size[0] % period_bytes)
-		rt5514_dsp->buf_size[0] = (rt5514_dsp->buf_size[0] / period_bytes) *
-			period_bytes;
-
-	if (rt5514_dsp->get_size[0] >= rt5514_dsp->buf_size[0]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp_addr[0], (u8 *)&buf,
-			sizeof(buf));
-		cur_wp = buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((cur_wp & 0xffe00000) != 0x4fe00000) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_0,
-				msecs_to_jiffies(50));
-			goto done;
-		}
-
-		if (cur_wp >= rt5514_dsp->buf_rp[0])
-			remain_data = (cur_wp - rt5514_dsp->buf_rp[0]);
-		else
-			remain_data =
-				(rt5514_dsp->buf_limit[0] - rt5514_dsp->buf_rp[0]) +
-				(cur_wp - rt5514_dsp->buf_base[0]);
-
-		if (remain_data < period_bytes) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_0,
-				msecs_to_jiffies(50));
-			goto done;
-		}
-	}
+	struct rt5514_stream *stream =
+		container_of(timer, struct rt5514_stream, poll_timer);
 
-	if (rt5514_dsp->buf_rp[0] + period_bytes <= rt5514_dsp->buf_limit[0]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[0],
-			runtime->dma_area + rt5514_dsp->dma_offset[0],
-			period_bytes);
-
-		if (rt5514_dsp->buf_rp[0] + period_bytes == rt5514_dsp->buf_limit[0])
-			rt5514_dsp->buf_rp[0] = rt5514_dsp->buf_base[0];
-		else
-			rt5514_dsp->buf_rp[0] += period_bytes;
-	} else {
-		truncated_bytes = rt5514_dsp->buf_limit[0] - rt5514_dsp->buf_rp[0];
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[0],
-			runtime->dma_area + rt5514_dsp->dma_offset[0],
-			truncated_bytes);
+	kthread_queue_delayed_work(stream->dsp->worker, &stream->copy_work, 0);
 
-		rt5514_spi_burst_read(rt5514_dsp->buf_base[0],
-			runtime->dma_area + rt5514_dsp->dma_offset[0] +
-			truncated_bytes, period_bytes - truncated_bytes);
+	return HRTIMER_NORESTART;
+}
 
-		rt5514_dsp->buf_rp[0] = rt5514_dsp->buf_base[0] + period_bytes -
-			truncated_bytes;
+/* Run the copy work of @stream again after @ns. Called with dma_lock held. */
+static void rt5514_spi_poll(struct rt5514_stream *stream, u64 ns)
+{
+	if (!ns) {
+		kthread_queue_delayed_work(stream->dsp->worker,
+			&stream->copy_work, 0);
+		return;
 	}
 
-	rt5514_dsp->get_size[0] += period_bytes;
-	rt5514_dsp->dma_offset[0] += period_bytes;
-	if (rt5514_dsp->dma_offset[0] >= runtime->dma_bytes)
-		rt5514_dsp->dma_offset[0] = 0;
+	hrtimer_start(&stream->poll_timer, ns_to_ktime(ns), HRTIMER_MODE_REL);
+}
 
-	snd_pcm_period_elapsed(rt5514_dsp->substream[0]);
+/* Time until @bytes more bytes are in the DSP ring at the stream rate */
+static u64 rt5514_spi_fill_ns(struct snd_pcm_runtime *runtime, size_t bytes)
+{
+	u64 rate = frames_to_bytes(runtime, runtime->rate);
 
-	schedule_delayed_work(&rt5514_dsp->copy_work_0, msecs_to_jiffies(10));
+	if (!rate)
+		return RT5514_POLL_RETRY_NS;
 
-done:
-	mutex_unlock(&rt5514_dsp->dma_lock);
+	return div64_u64((u64)bytes * NSEC_PER_SEC, rate) +
+		RT5514_POLL_SLACK_NS;
 }
 
-static void rt5514_spi_copy_work_1(struct work_struct *work)
+/*
+ * Returns how long the copy work of @stream, @missing bytes short of a
+ * period, waits before it looks again: until the missing bytes should have
+ * arrived at the stream rate. In watermark mode the stream waits for its
+ * period as fill watermark, and the smallest watermark of the waiting
+ * streams is armed again at every wait, as the firmware drops it once it
+ * fired. The copy work is kicked from the IRQ when it is reached, with a
+ * timeout of two periods as a safety net. Only firmware whose version
+ * header announced the mailbox is written to, other firmware keeps the
+ * stream on polling. Called with dma_lock held.
+ */
+static u64 rt5514_spi_data_wait(struct rt5514_stream *stream,
+	struct snd_pcm_runtime *runtime, size_t period_bytes, size_t missing)
 {
-	struct rt5514_dsp *rt5514_dsp =
-		container_of(work, struct rt5514_dsp, copy_work_1.work);
-	struct snd_pcm_runtime *runtime;
-	size_t period_bytes, truncated_bytes = 0;
-	unsigned int cur_wp, remain_data;
-	u8 buf[8];
+	struct rt5514_dsp *rt5514_dsp = stream->dsp;
+	size_t wm_bytes = period_bytes;
+	unsigned int i;
 
-	mutex_lock(&rt5514_dsp->dma_lock);
-	if (!rt5514_dsp->substream[1]) {
-		dev_err(rt5514_dsp->dev, "No pcm1 substream\n");
-		goto done;
-	}
+	if (rt5514_dsp->wm_state != RT5514_WM_SUPPORTED)
+		return rt5514_spi_fill_ns(runtime, missing);
 
-	runtime = rt5514_dsp->substream[1]->runtime;
-	period_bytes = snd_pcm_lib_period_bytes(rt5514_dsp->substream[1]);
-	if (!period_bytes) {
-		schedule_delayed_work(&rt5514_dsp->copy_work_1,
-			msecs_to_jiffies(50));
-		goto done;
+	for (i = 0; i < RT5514_STREAM_NUM; i++) {
+		if (rt5514_dsp->stream[i].wm_bytes &&
+			rt5514_dsp->stream[i].wm_bytes < wm_bytes)
+			wm_bytes = rt5514_dsp->stream[i].wm_bytes;
 	}
 
-	if (rt5514_dsp->buf_size[1] % period_bytes)
-		rt5514_dsp->buf_size[1] = (rt5514_dsp->buf_size[1] / period_bytes) *
-			period_bytes;
-
-	if (rt5514_dsp->get_size[1] >= rt5514_dsp->buf_size[1]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp_addr[1], (u8 *)&buf,
-			sizeof(buf));
-		cur_wp = buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((cur_wp & 0xffe00000) != 0x4fe00000) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_1,
-				msecs_to_jiffies(50));
-			goto done;
-		}
-
-		if (cur_wp >= rt5514_dsp->buf_rp[1])
-			remain_data = (cur_wp - rt5514_dsp->buf_rp[1]);
-		else
-			remain_data =
-				(rt5514_dsp->buf_limit[1] - rt5514_dsp->buf_rp[1]) +
-				(cur_wp - rt5514_dsp->buf_base[1]);
-
-		if (remain_data < period_bytes) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_1,
-				msecs_to_jiffies(50));
-			goto done;
-		}
+	if (rt5514_spi_stream_reg_write(rt5514_dsp, rt5514_dsp->wm_mailbox,
+		wm_bytes)) {
+		stream->wm_bytes = 0;
+		return rt5514_spi_fill_ns(runtime, missing);
 	}
 
-	if (rt5514_dsp->buf_rp[1] + period_bytes <= rt5514_dsp->buf_limit[1]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[1],
-			runtime->dma_area + rt5514_dsp->dma_offset[1],
-			period_bytes);
+	stream->wm_bytes = period_bytes;
 
-		if (rt5514_dsp->buf_rp[1] + period_bytes == rt5514_dsp->buf_limit[1])
-			rt5514_dsp->buf_rp[1] = rt5514_dsp->buf_base[1];
-		else
-			rt5514_dsp->buf_rp[1] += period_bytes;
-	} else {
-		truncated_bytes = rt5514_dsp->buf_limit[1] - rt5514_dsp->buf_rp[1];
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[1],
-			runtime->dma_area + rt5514_dsp->dma_offset[1],
-			truncated_bytes);
-
-		rt5514_spi_burst_read(rt5514_dsp->buf_base[1],
-			runtime->dma_area + rt5514_dsp->dma_offset[1] +
-			truncated_bytes, period_bytes - truncated_bytes);
+	return rt5514_spi_fill_ns(runtime, 2 * period_bytes);
+}
 
-		rt5514_dsp->buf_rp[1] = rt5514_dsp->buf_base[1] + period_bytes -
-			truncated_bytes;
-	}
+/*
+ * Look up in the version header of the running firmware whether it has the
+ * watermark mailbox, before anything is written to it. The firmware may
+ * have been reloaded since the last stream, so this runs at every stream
+ * start, and the outcome is only logged when it changes.
+ */
+static void rt5514_spi_wm_probe(struct rt5514_dsp *rt5514_dsp)
+{
+	enum rt5514_wm_state state = RT5514_WM_UNSUPPORTED;
+	RT5514_DSP_FW_VER ver = { 0 };
+	unsigned int addr = 0, i;
 
-	rt5514_dsp->get_size[1] += period_bytes;
-	rt5514_dsp->dma_offset[1] += period_bytes;
-	if (rt5514_dsp->dma_offset[1] >= runtime->dma_bytes)
-		rt5514_dsp->dma_offset[1] = 0;
+	if (!rt5514_dsp->wm_mode)
+		return;
 
-	snd_pcm_period_elapsed(rt5514_dsp->substream[1]);
+	mutex_lock(&rt5514_dsp_list_lock);
+	if (rt5514_dsp->codec)
+		addr = rt5514_dsp->codec->fw_addr[0] + RT5514_FW_VER_OFFSET;
+	mutex_unlock(&rt5514_dsp_list_lock);
 
-	schedule_delayed_work(&rt5514_dsp->copy_work_1, msecs_to_jiffies(10));
+	if (!addr)
+		return;
+	if ((addr & 0xffe00000) == 0x4fe00000 &&
+		!rt5514_spi_read_range(rt5514_dsp, addr, (u8 *)&ver,
+			sizeof(ver), RT5514_SPI_CLASS_CTRL, NULL) &&
+		(ver.feature_id & rt5514_dsp->wm_feature) ==
+			rt5514_dsp->wm_feature)
+		state = RT5514_WM_SUPPORTED;
 
-done:
+	mutex_lock(&rt5514_dsp->dma_lock);
+	if (state != rt5514_dsp->wm_state)
+		dev_info(rt5514_dsp->dev, "Firmware %u.%u.%u.%u %s\n",
+			ver.chip_id, ver.feature_id, ver.version,
+			ver.sub_version, state == RT5514_WM_SUPPORTED ?
+			"has fill watermarks" : "has no fill watermarks, polling");
+	rt5514_dsp->wm_state = state;
+	for (i = 0; i < RT5514_STREAM_NUM; i++)
+		rt5514_dsp->stream[i].wm_bytes = 0;
 	mutex_unlock(&rt5514_dsp->dma_lock);
 }
 
-static void rt5514_spi_copy_work_2(struct work_struct *work)
+/*
+ * Returns when to copy again, with @left bytes known to be in the ring:
+ * at the PCM pace if the copy was held back by a full PCM buffer, right
+ * away if a period is waiting or the pre-roll was just drained, else once
+ * the next period should be complete.
+ */
+static u64 rt5514_spi_next_ns(struct snd_pcm_runtime *runtime,
+	size_t period_bytes, bool live, size_t left, bool throttled)
 {
-	struct rt5514_dsp *rt5514_dsp =
-		container_of(work, struct rt5514_dsp, copy_work_2.work);
-	struct snd_pcm_runtime *runtime;
-	size_t period_bytes, truncated_bytes = 0;
-	unsigned int cur_wp, remain_data;
-	u8 buf[8];
+	if (throttled)
+		return RT5514_POLL_PACE_NS;
 
-	mutex_lock(&rt5514_dsp->dma_lock);
-	if (!rt5514_dsp->substream[2]) {
-		dev_err(rt5514_dsp->dev, "No pcm2 substream\n");
-		goto done;
-	}
+	if (left >= period_bytes || !live)
+		return 0;
 
-	runtime = rt5514_dsp->substream[2]->runtime;
-	period_bytes = snd_pcm_lib_period_bytes(rt5514_dsp->substream[2]);
-	if (!period_bytes) {
-		schedule_delayed_work(&rt5514_dsp->copy_work_2,
-			msecs_to_jiffies(50));
-		goto done;
+	return rt5514_spi_fill_ns(runtime, period_bytes - left);
+}
+
+/* Run the copy works that are waiting for data now */
+static void rt5514_spi_kick_copy(struct rt5514_dsp *rt5514_dsp)
+{
+	struct rt5514_stream *stream;
+	unsigned int i;
+
+	for (i = 0; i < RT5514_STREAM_NUM; i++) {
+		stream = &rt5514_dsp->stream[i];
+		if (hrtimer_try_to_cancel(&stream->poll_timer) > 0)
+			kthread_queue_delayed_work(rt5514_dsp->worker,
+				&stream->copy_work, 0);
 	}
+}
 
-	if (rt5514_dsp->buf_size[2] % period_bytes)
-		rt5514_dsp->buf_size[2] = (rt5514_dsp->buf_size[2] / period_bytes) *
-			period_bytes;
+/*
+ * The write pointer only gives the ring position modulo the ring size, so
+ * a lapped read pointer is caught from two sides: the unread data must not
+ * shrink between two looks, and the DSP must not have produced a whole ring
+ * at the ring rate since the last look, which leaves the unread data
+ * looking unchanged. The read pointer of a pre-roll drain starts right
+ * ahead of the write pointer, so a tighter estimate would report it as
+ * lapped at once.
+ */
+static bool rt5514_spi_overrun(struct rt5514_stream *stream,
+	unsigned int remain_data, ktime_t now)
+{
+	size_t ring = stream->buf_limit - stream->buf_base;
+	s64 us = ktime_us_delta(now, stream->wp_stamp);
+	u64 produced;
 
-	if (rt5514_dsp->get_size[2] >= rt5514_dsp->buf_size[2]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp_addr[2], (u8 *)&buf,
-			sizeof(buf));
-		cur_wp = buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((cur_wp & 0xffe00000) != 0x4fe00000) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_2,
-				msecs_to_jiffies(50));
-			goto done;
-		}
+	if (remain_data < stream->left)
+		return true;
 
-		if (cur_wp >= rt5514_dsp->buf_rp[2])
-			remain_data = (cur_wp - rt5514_dsp->buf_rp[2]);
-		else
-			remain_data =
-				(rt5514_dsp->buf_limit[2] - rt5514_dsp->buf_rp[2]) +
-				(cur_wp - rt5514_dsp->buf_base[2]);
+	if (us <= 0)
+		return false;
 
-		if (remain_data < period_bytes) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_2,
-				msecs_to_jiffies(50));
-			goto done;
-		}
-	}
+	produced = div_u64((u64)us * stream->desc->rate * 2, USEC_PER_SEC);
+
+	return produced >= ring;
+}
 
-	if (rt5514_dsp->buf_rp[2] + period_bytes <= rt5514_dsp->buf_limit[2]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[2],
-			runtime->dma_area + rt5514_dsp->dma_offset[2],
-			period_bytes);
+/*
+ * Returns the bytes from the read pointer up to @cur_wp. The read pointer
+ * of a pre-roll drain is never behind the write pointer, so with @preroll
+ * equal pointers mean a full ring.
+ */
+static unsigned int rt5514_spi_unread(struct rt5514_stream *stream,
+	unsigned int cur_wp, bool preroll)
+{
+	if (cur_wp > stream->buf_rp)
+		return cur_wp - stream->buf_rp;
 
-		if (rt5514_dsp->buf_rp[2] + period_bytes == rt5514_dsp->buf_limit[2])
-			rt5514_dsp->buf_rp[2] = rt5514_dsp->buf_base[2];
-		else
-			rt5514_dsp->buf_rp[2] += period_bytes;
-	} else {
-		truncated_bytes = rt5514_dsp->buf_limit[2] - rt5514_dsp->buf_rp[2];
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[2],
-			runtime->dma_area + rt5514_dsp->dma_offset[2],
-			truncated_bytes);
+	if (cur_wp == stream->buf_rp && !preroll)
+		return 0;
 
-		rt5514_spi_burst_read(rt5514_dsp->buf_base[2],
-			runtime->dma_area + rt5514_dsp->dma_offset[2] +
-			truncated_bytes, period_bytes - truncated_bytes);
+	return (stream->buf_limit - stream->buf_rp) +
+		(cur_wp - stream->buf_base);
+}
 
-		rt5514_dsp->buf_rp[2] = rt5514_dsp->buf_base[2] + period_bytes -
-			truncated_bytes;
-	}
+/*
+ * Count an overrun, report it as an xrun if so configured, and move the
+ * read pointer to the oldest data the DSP will not overwrite within the
+ * next period. Returns the unread bytes from there.
+ */
+static unsigned int rt5514_spi_resync(struct rt5514_stream *stream,
+	unsigned int cur_wp, size_t period_bytes)
+{
+	struct rt5514_dsp *rt5514_dsp = stream->dsp;
+	size_t ring = stream->buf_limit - stream->buf_base;
 
-	rt5514_dsp->get_size[2] += period_bytes;
-	rt5514_dsp->dma_offset[2] += period_bytes;
-	if (rt5514_dsp->dma_offset[2] >= runtime->dma_bytes)
-		rt5514_dsp->dma_offset[2] = 0;
+	stream->overruns++;
+	dev_warn_ratelimited(rt5514_dsp->dev, "pcm%u DSP ring overrun\n",
+		stream->id);
 
-	snd_pcm_period_elapsed(rt5514_dsp->substream[2]);
+	if (rt5514_dsp->overrun_xrun)
+		snd_pcm_stop_xrun(stream->substream);
 
-	schedule_delayed_work(&rt5514_dsp->copy_work_2, msecs_to_jiffies(10));
+	stream->buf_rp = round_down(cur_wp, 8) + period_bytes;
+	if (stream->buf_rp >= stream->buf_limit)
+		stream->buf_rp -= ring;
 
-done:
-	mutex_unlock(&rt5514_dsp->dma_lock);
+	return ring - period_bytes;
 }
 
-static void rt5514_spi_copy_work_3(struct work_struct *work)
+/*
+ * Copy whole periods of a stream from its DSP ring to the PCM buffer. All
+ * periods available in the ring are copied at once, as far as the PCM
+ * buffer has room for them and up to its end, with one read or two at the
+ * ring wrap, so a pre-roll backlog reaches userspace at the SPI line rate.
+ * At least one period is always copied, as the PCM buffer may overrun.
+ */
+static void rt5514_spi_copy_work(struct kthread_work *work)
 {
-	struct rt5514_dsp *rt5514_dsp =
-		container_of(work, struct rt5514_dsp, copy_work_3.work);
+	struct rt5514_stream *stream =
+		container_of(work, struct rt5514_stream, copy_work.work);
+	struct rt5514_dsp *rt5514_dsp = stream->dsp;
 	struct snd_pcm_runtime *runtime;
-	size_t period_bytes, truncated_bytes = 0;
+	size_t period_bytes, truncated_bytes, len, room;
 	unsigned int cur_wp, remain_data;
-	u8 buf[8];
+	bool live, bus_locked, throttled, ok;
+	ktime_t now;
 
 	mutex_lock(&rt5514_dsp->dma_lock);
-	if (!rt5514_dsp->substream[3]) {
-		dev_err(rt5514_dsp->dev, "No pcm1 substream\n");
+	if (!stream->substream) {
+		dev_err(rt5514_dsp->dev, "No pcm%u substream\n", stream->id);
 		goto done;
 	}
 
-	runtime = rt5514_dsp->substream[3]->runtime;
-	period_bytes = snd_pcm_lib_period_bytes(rt5514_dsp->substream[3]);
+	runtime = stream->substream->runtime;
+	period_bytes = snd_pcm_lib_period_bytes(stream->substream);
 	if (!period_bytes) {
-		schedule_delayed_work(&rt5514_dsp->copy_work_3,
-			msecs_to_jiffies(50));
+		rt5514_spi_poll(stream, RT5514_POLL_RETRY_NS);
 		goto done;
 	}
 
-	if (rt5514_dsp->buf_size[3] % period_bytes)
-		rt5514_dsp->buf_size[3] = (rt5514_dsp->buf_size[3] / period_bytes) *
+	if (stream->buf_size % period_bytes)
+		stream->buf_size = (stream->buf_size / period_bytes) *
 			period_bytes;
 
-	if (rt5514_dsp->get_size[3] >= rt5514_dsp->buf_size[3]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp_addr[3], (u8 *)&buf,
-			sizeof(buf));
-		cur_wp = buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((cur_wp & 0xffe00000) != 0x4fe00000) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_3,
-				msecs_to_jiffies(50));
-			goto done;
-		}
+	live = stream->get_size >= stream->buf_size;
 
-		if (cur_wp >= rt5514_dsp->buf_rp[3])
-			remain_data = (cur_wp - rt5514_dsp->buf_rp[3]);
-		else
-			remain_data =
-				(rt5514_dsp->buf_limit[3] - rt5514_dsp->buf_rp[3]) +
-				(cur_wp - rt5514_dsp->buf_base[3]);
+	/* The DSP keeps writing during the pre-roll drain too */
+	if (rt5514_spi_ring_read(rt5514_dsp, &stream->desc->wp_addr,
+		&cur_wp, 1, false))
+		cur_wp = 0;
+	if ((cur_wp & 0xffe00000) != 0x4fe00000) {
+		rt5514_spi_poll(stream, RT5514_POLL_RETRY_NS);
+		goto done;
+	}
+
+	remain_data = rt5514_spi_unread(stream, cur_wp, !live);
+
+	now = ktime_get();
+	if (rt5514_spi_overrun(stream, remain_data, now))
+		remain_data = rt5514_spi_resync(stream, cur_wp, period_bytes);
+
+	stream->left = remain_data;
+	stream->wp_stamp = now;
 
+	if (live) {
 		if (remain_data < period_bytes) {
-			schedule_delayed_work(&rt5514_dsp->copy_work_3,
-				msecs_to_jiffies(50));
+			rt5514_spi_poll(stream,
+				rt5514_spi_data_wait(stream, runtime,
+				period_bytes, period_bytes - remain_data));
 			goto done;
 		}
+
+		stream->wm_bytes = 0;
+	} else {
+		remain_data = min_t(size_t, remain_data,
+			stream->buf_size - stream->get_size);
 	}
 
-	if (rt5514_dsp->buf_rp[3] + period_bytes <= rt5514_dsp->buf_limit[3]) {
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[3],
-			runtime->dma_area + rt5514_dsp->dma_offset[3],
-			period_bytes);
+	room = frames_to_bytes(runtime,
+		runtime->buffer_size - snd_pcm_capture_avail(runtime));
+	throttled = room < remain_data;
 
-		if (rt5514_dsp->buf_rp[3] + period_bytes == rt5514_dsp->buf_limit[3])
-			rt5514_dsp->buf_rp[3] = rt5514_dsp->buf_base[3];
-		else
-			rt5514_dsp->buf_rp[3] += period_bytes;
+	len = min_t(size_t, remain_data, max(room, period_bytes));
+	len = min_t(size_t, len, runtime->dma_bytes - stream->dma_offset);
+	len = round_down(len, period_bytes);
+
+	/* Keep the pre-roll drain free of other traffic on the bus */
+	bus_locked = rt5514_dsp->bus_lock_mode &&
+		stream->desc->preroll_bus_lock && !live;
+	if (bus_locked)
+		rt5514_spi_bus_lock(rt5514_dsp);
+
+	if (stream->buf_rp + len <= stream->buf_limit) {
+		truncated_bytes = len;
+		ok = rt5514_spi_stream_read(rt5514_dsp, stream->buf_rp,
+			runtime->dma_area + stream->dma_offset, len);
 	} else {
-		truncated_bytes = rt5514_dsp->buf_limit[3] - rt5514_dsp->buf_rp[3];
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp[3],
-			runtime->dma_area + rt5514_dsp->dma_offset[3],
-			truncated_bytes);
+		truncated_bytes = stream->buf_limit - stream->buf_rp;
+		ok = rt5514_spi_stream_read(rt5514_dsp, stream->buf_rp,
+			runtime->dma_area + stream->dma_offset,
+			truncated_bytes) &&
+			rt5514_spi_stream_read(rt5514_dsp, stream->buf_base,
+			runtime->dma_area + stream->dma_offset +
+			truncated_bytes, len - truncated_bytes);
+	}
 
-		rt5514_spi_burst_read(rt5514_dsp->buf_base[3],
-			runtime->dma_area + rt5514_dsp->dma_offset[3] +
-			truncated_bytes, period_bytes - truncated_bytes);
+	if (bus_locked)
+		rt5514_spi_bus_unlock(rt5514_dsp);
 
-		rt5514_dsp->buf_rp[3] = rt5514_dsp->buf_base[3] + period_bytes -
-			truncated_bytes;
+	/* Nothing is handed out or consumed, the same data is read again */
+	if (!ok) {
+		dev_err_ratelimited(rt5514_dsp->dev, "pcm%u ring read failed\n",
+			stream->id);
+		rt5514_spi_poll(stream, RT5514_POLL_RETRY_NS);
+		goto done;
 	}
 
-	rt5514_dsp->get_size[3] += period_bytes;
-	rt5514_dsp->dma_offset[3] += period_bytes;
-	if (rt5514_dsp->dma_offset[3] >= runtime->dma_bytes)
-		rt5514_dsp->dma_offset[3] = 0;
+	if (stream->buf_rp + len >= stream->buf_limit)
+		stream->buf_rp = stream->buf_base + len - truncated_bytes;
+	else
+		stream->buf_rp += len;
+
+	stream->left -= len;
+	stream->get_size += len;
+	stream->dma_offset += len;
+	if (stream->dma_offset >= runtime->dma_bytes)
+		stream->dma_offset = 0;
 
-	snd_pcm_period_elapsed(rt5514_dsp->substream[3]);
+	snd_pcm_period_elapsed(stream->substream);
 
-	schedule_delayed_work(&rt5514_dsp->copy_work_3, msecs_to_jiffies(10));
+	rt5514_spi_poll(stream, rt5514_spi_next_ns(runtime, period_bytes,
+		live, remain_data - len, throttled));
 
 done:
 	mutex_unlock(&rt5514_dsp->dma_lock);
 }
 
-static void rt5514_schedule_copy(struct rt5514_dsp *rt5514_dsp, bool is_adc)
+/*
+ * Read the ring descriptors of a stream and start its copy work. With
+ * @preroll the ring contents past the ignore window are delivered first,
+ * otherwise the stream is live from the current write pointer on. Runs on
+ * the system workqueue, so the stream state is only set up under dma_lock.
+ */
+static void rt5514_spi_stream_start(struct rt5514_stream *stream,
+	bool preroll)
 {
-	u8 buf[8];
-	unsigned int base_addr, limit_addr, truncated_bytes, buf_ignore_size = 0;
-	unsigned int irq_flag, stream_flag;
+	const struct rt5514_stream_desc *desc = stream->desc;
+	struct rt5514_dsp *rt5514_dsp = stream->dsp;
+	unsigned int buf_base, buf_limit, buf_rp, buf_size, cur_wp;
+	unsigned int truncated_bytes, buf_ignore_size;
+	unsigned int addrs[3], vals[3];
 	int retry_cnt = 0;
 
-	if (is_adc) {
-		stream_flag = RT5514_DSP_STREAM_ADC;
-		base_addr = RT5514_BUFFER_ADC_BASE;
-		limit_addr = RT5514_BUFFER_ADC_LIMIT;
-		rt5514_dsp->buf_rp_addr[2] = RT5514_BUFFER_ADC_WP;
-	} else {
-		rt5514_spi_burst_read(RT5514_IRQ_FLAG, (u8 *)&buf, sizeof(buf));
-		irq_flag = buf[0] | buf[1] << 8 | buf[2] << 16 |
-			buf[3] << 24;
-
-		if (irq_flag & RT5514_DSP_HOTWORD) {
-			stream_flag = RT5514_DSP_STREAM_HOTWORD;
-			base_addr = RT5514_BUFFER_VOICE_BASE;
-			limit_addr = RT5514_BUFFER_VOICE_LIMIT;
-			rt5514_dsp->buf_rp_addr[0] = RT5514_BUFFER_VOICE_WP;
-			buf_ignore_size = rt5514_dsp->hotword_ignore_ms * 2 * 16;
-			memset(buf, 0, sizeof(buf));
-			rt5514_spi_burst_write(RT5514_IRQ_FLAG, buf, 8);
-		} else if (irq_flag & RT5514_DSP_MUSDET) {
-			stream_flag = RT5514_DSP_STREAM_MUSDET;
-			base_addr = RT5514_BUFFER_MUSIC_BASE;
-			limit_addr = RT5514_BUFFER_MUSIC_LIMIT;
-			rt5514_dsp->buf_rp_addr[1] = RT5514_BUFFER_MUSIC_WP;
-			buf_ignore_size = rt5514_dsp->musdet_ignore_ms * 16;
-			memset(buf, 0, sizeof(buf));
-			rt5514_spi_burst_write(RT5514_IRQ_FLAG, buf, 8);
-		} else if (irq_flag & RT5514_DSP_MUSDET_BREAK) {
-			stream_flag = RT5514_DSP_STREAM_MUSDET_BRK;
-			base_addr = RT5514_BUFFER_MUSIC_BASE;
-			limit_addr = RT5514_BUFFER_MUSIC_LIMIT;
-			rt5514_dsp->buf_rp_addr[3] = RT5514_BUFFER_MUSIC_WP;
-			buf_ignore_size = rt5514_dsp->musdet_brk_ignore_ms * 16;
-			memset(buf, 0, sizeof(buf));
-			rt5514_spi_burst_write(RT5514_IRQ_FLAG, buf, 8);
-		} else {
-			return;
-		}
-
-		if (stream_flag == RT5514_DSP_STREAM_HOTWORD) {
-			if (!rt5514_dsp->substream[0] || rt5514_dsp->stream_flag[0]) {
-				dev_err(rt5514_dsp->dev, "No pcm0 substream or it is streaming\n");
-				return;
-			} else {
-				rt5514_dsp->stream_flag[0] = stream_flag;
-				rt5514_dsp->get_size[0] = 0;
-			}
-		} else if (stream_flag == RT5514_DSP_STREAM_MUSDET) {
-			if (!rt5514_dsp->substream[1] || rt5514_dsp->stream_flag[1]) {
-				dev_err(rt5514_dsp->dev, "No pcm1 substream or it is streaming\n");
-				return;
-			} else {
-				rt5514_dsp->stream_flag[1] = stream_flag;
-				rt5514_dsp->get_size[1] = 0;
-			}
-		} else if (stream_flag == RT5514_DSP_STREAM_MUSDET_BRK) {
-			if (!rt5514_dsp->substream[3] || rt5514_dsp->stream_flag[3]) {
-				dev_err(rt5514_dsp->dev, "No pcm3 substream or it is streaming\n");
-				return;
-			} else {
-				rt5514_dsp->stream_flag[3] = stream_flag;
-				rt5514_dsp->get_size[3] = 0;
-			}
-		} else {
-			return;
-		}
-	}
+	if (preroll)
+		buf_ignore_size = stream->ignore_ms * desc->ignore_bytes_per_ms;
+	else
+		buf_ignore_size = 0;
 
 	/**
 	 * The address area x1800XXXX is the register address, and it cannot
-	 * support spi burst read perfectly. So we use the spi burst read
-	 * individually to make sure the data correctly.
+	 * support spi burst read perfectly. So we read the registers
+	 * individually, through a fresh ring snapshot, to make sure the data
+	 * correctly.
 	 */
+	addrs[0] = desc->base_addr;
+	addrs[1] = desc->limit_addr;
+	addrs[2] = desc->wp_addr;
+
 	while (retry_cnt < RT5514_SPI_RETRY_CNT) {
 		/* sleep 10 ms if need retry*/
 		if (retry_cnt)
 			usleep_range(10000, 10010);
 		retry_cnt++;
 
-		rt5514_spi_burst_read(base_addr, (u8 *)&buf, sizeof(buf));
-		rt5514_dsp->buf_base[stream_flag - 1] =
-			buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((rt5514_dsp->buf_base[stream_flag - 1] & 0xffe00000) !=
-			0x4fe00000)
+		if (rt5514_spi_ring_read(rt5514_dsp, addrs, vals,
+			ARRAY_SIZE(vals), true))
 			continue;
 
-		rt5514_spi_burst_read(limit_addr, (u8 *)&buf, sizeof(buf));
-		rt5514_dsp->buf_limit[stream_flag - 1] =
-			buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((rt5514_dsp->buf_limit[stream_flag - 1] & 0xffe00000) !=
-			0x4fe00000)
+		buf_base = vals[0];
+		if ((buf_base & 0xffe00000) != 0x4fe00000)
 			continue;
 
-		if (rt5514_dsp->buf_limit[stream_flag - 1] % 8)
-			rt5514_dsp->buf_limit[stream_flag - 1] =
-			((rt5514_dsp->buf_limit[stream_flag - 1] / 8) + 1) * 8;
+		buf_limit = vals[1];
+		if ((buf_limit & 0xffe00000) != 0x4fe00000)
+			continue;
+
+		if (buf_limit % 8)
+			buf_limit = ((buf_limit / 8) + 1) * 8;
 
-		rt5514_spi_burst_read(rt5514_dsp->buf_rp_addr[stream_flag - 1],
-			(u8 *)&buf, sizeof(buf));
-		rt5514_dsp->buf_rp[stream_flag - 1] =
-			buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
-		if ((rt5514_dsp->buf_rp[stream_flag - 1] & 0xffe00000) !=
-			0x4fe00000)
+		buf_rp = vals[2];
+		if ((buf_rp & 0xffe00000) != 0x4fe00000)
 			continue;
 		else
 			break;
 	}
+	cur_wp = buf_rp;
+
+	spin_lock(&rt5514_dsp->stats_lock);
+	rt5514_dsp->stats.retries += retry_cnt - 1;
+	spin_unlock(&rt5514_dsp->stats_lock);
 
 	if (retry_cnt == RT5514_SPI_RETRY_CNT) {
 		pr_err("%s: Fail for address read", __func__);
 		return;
 	}
 
-	rt5514_dsp->buf_rp[stream_flag - 1] += buf_ignore_size;
+	buf_rp += buf_ignore_size;
 
-	if (rt5514_dsp->buf_rp[stream_flag - 1] >= rt5514_dsp->buf_limit[stream_flag - 1]) {
-		truncated_bytes = rt5514_dsp->buf_rp[stream_flag - 1] -
-			rt5514_dsp->buf_limit[stream_flag - 1];
+	if (buf_rp >= buf_limit) {
+		truncated_bytes = buf_rp - buf_limit;
 
-		rt5514_dsp->buf_rp[stream_flag - 1] = rt5514_dsp->buf_base[stream_flag - 1] +
-			truncated_bytes;
+		buf_rp = buf_base + truncated_bytes;
 	}
 
-	if (rt5514_dsp->buf_rp[stream_flag - 1] % 8)
-		rt5514_dsp->buf_rp[stream_flag - 1] = (rt5514_dsp->buf_rp[stream_flag - 1] / 8) * 8;
-
-	rt5514_dsp->buf_size[stream_flag - 1] = rt5514_dsp->buf_limit[stream_flag - 1] -
-		rt5514_dsp->buf_base[stream_flag - 1] - buf_ignore_size;
-
-	if (rt5514_dsp->buf_base[stream_flag - 1] && rt5514_dsp->buf_limit[stream_flag - 1] &&
-		rt5514_dsp->buf_rp[stream_flag - 1] && rt5514_dsp->buf_size[stream_flag - 1]) {
-
-		if (is_adc)
-			schedule_delayed_work(&rt5514_dsp->copy_work_2,
-				msecs_to_jiffies(0));
-		else if (stream_flag == RT5514_DSP_STREAM_HOTWORD)
-			schedule_delayed_work(&rt5514_dsp->copy_work_0,
-				msecs_to_jiffies(0));
-		else if (stream_flag == RT5514_DSP_STREAM_MUSDET)
-			schedule_delayed_work(&rt5514_dsp->copy_work_1,
-				msecs_to_jiffies(0));
-		else if (stream_flag == RT5514_DSP_STREAM_MUSDET_BRK)
-			schedule_delayed_work(&rt5514_dsp->copy_work_3,
-				msecs_to_jiffies(0));
+	/*
+	 * A pre-roll starts at or ahead of the write pointer, on the oldest
+	 * data, a live stream at or behind it, on the newest
+	 */
+	if (buf_rp % 8) {
+		if (preroll)
+			buf_rp = ((buf_rp / 8) + 1) * 8;
 		else
-			return;
+			buf_rp = (buf_rp / 8) * 8;
 	}
-}
+	if (buf_rp >= buf_limit)
+		buf_rp = buf_base;
 
-static void rt5514_spi_start_work(struct work_struct *work) {
-	struct rt5514_dsp *rt5514_dsp =
-		container_of(work, struct rt5514_dsp, start_work.work);
-	struct snd_soc_component *component = rt5514_dsp->component;
+	buf_size = buf_limit - buf_base - buf_ignore_size;
 
-	if (!snd_power_wait(component->card->snd_card, SNDRV_CTL_POWER_D0)) {
-		if (rt5514_watchdog_dbg_info(rt5514_dsp)) {
-			rt5514_watchdog_handler();
-			return;
+	rt5514_spi_wm_probe(rt5514_dsp);
+
+	mutex_lock(&rt5514_dsp->dma_lock);
+	if (!stream->substream)
+		goto unlock;
+
+	stream->buf_base = buf_base;
+	stream->buf_limit = buf_limit;
+	stream->buf_rp = buf_rp;
+	stream->buf_size = buf_size;
+
+	/* The ring is full of pre-roll from here on, unless skipped */
+	if (preroll) {
+		stream->get_size = 0;
+		stream->left = rt5514_spi_unread(stream, cur_wp, true);
+	} else {
+		stream->get_size = buf_size;
+		stream->left = 0;
+	}
+	stream->wp_stamp = ktime_get();
+
+	if (buf_base && buf_limit && buf_rp && buf_size)
+		kthread_queue_delayed_work(rt5514_dsp->worker,
+			&stream->copy_work, 0);
+
+unlock:
+	mutex_unlock(&rt5514_dsp->dma_lock);
+}
+
+/* Start the stream whose DSP event raised the IRQ */
+static void rt5514_schedule_copy(struct rt5514_dsp *rt5514_dsp)
+{
+	struct rt5514_stream *stream = NULL;
+	unsigned int irq_flag, i;
+	bool busy;
+
+	if (rt5514_spi_stream_reg_read(rt5514_dsp, RT5514_IRQ_FLAG, &irq_flag))
+		return;
+
+	if (irq_flag & rt5514_dsp->wm_irq) {
+		irq_flag &= ~rt5514_dsp->wm_irq;
+		rt5514_spi_stream_reg_write(rt5514_dsp, RT5514_IRQ_FLAG,
+			irq_flag);
+		rt5514_spi_kick_copy(rt5514_dsp);
+	}
+
+	for (i = 0; i < RT5514_STREAM_NUM; i++) {
+		if (rt5514_stream_descs[i].irq_flag & irq_flag) {
+			stream = &rt5514_dsp->stream[i];
+			break;
 		}
 	}
 
+	if (!stream)
+		return;
+
+	rt5514_spi_stream_reg_write(rt5514_dsp, RT5514_IRQ_FLAG, 0);
+	rt5514_spi_stream_reg_write(rt5514_dsp, RT5514_IRQ_FLAG + 4, 0);
+
+	/* A continuous stream already delivers the audio around the event */
+	if (stream->continuous)
+		return;
+
 	mutex_lock(&rt5514_dsp->dma_lock);
-	if (!(rt5514_dsp->substream[0] && rt5514_dsp->substream[0]->pcm) &&
-		!(rt5514_dsp->substream[1] && rt5514_dsp->substream[1]->pcm) &&
-		!(rt5514_dsp->substream[3] && rt5514_dsp->substream[3]->pcm)) {
-		mutex_unlock(&rt5514_dsp->dma_lock);
+	busy = !stream->substream || stream->stream_flag;
+	if (!busy)
+		stream->stream_flag = stream->desc->stream_flag;
+	mutex_unlock(&rt5514_dsp->dma_lock);
+
+	if (busy) {
+		dev_err(rt5514_dsp->dev,
+			"No pcm%u substream or it is streaming\n", i);
 		return;
 	}
+
+	rt5514_spi_stream_start(stream, true);
+}
+
+static void rt5514_spi_start_work(struct work_struct *work) {
+	struct rt5514_dsp *rt5514_dsp =
+		container_of(work, struct rt5514_dsp, start_work.work);
+	struct snd_soc_component *component = rt5514_dsp->component;
+	struct rt5514_stream *stream;
+	struct rt5514_priv *codec;
+	bool watchdog = false;
+	unsigned int i;
+
+	if (!snd_power_wait(component->card->snd_card, SNDRV_CTL_POWER_D0)) {
+		/* Nothing to recover without the codec */
+		mutex_lock(&rt5514_dsp_list_lock);
+		codec = rt5514_dsp->codec;
+		if (codec && rt5514_watchdog_dbg_info(rt5514_dsp, codec)) {
+			rt5514_watchdog_handler(codec);
+			watchdog = true;
+		}
+		mutex_unlock(&rt5514_dsp_list_lock);
+
+		if (watchdog)
+			return;
+	}
+
+	/* Only streams started by the IRQ, or any in watermark mode */
+	mutex_lock(&rt5514_dsp->dma_lock);
+	for (i = 0; i < RT5514_STREAM_NUM; i++) {
+		stream = &rt5514_dsp->stream[i];
+		if ((stream->desc->irq_flag || rt5514_dsp->wm_mode) &&
+			stream->substream && stream->substream->pcm)
+			break;
+	}
 	mutex_unlock(&rt5514_dsp->dma_lock);
 
-	rt5514_schedule_copy(rt5514_dsp, false);
+	if (i == RT5514_STREAM_NUM)
+		return;
+
+	rt5514_schedule_copy(rt5514_dsp);
 }
 
-static void rt5514_spi_adc_start(struct work_struct *work)
+static void rt5514_spi_arm_work(struct work_struct *work)
 {
-	struct rt5514_dsp *rt5514_dsp =
-		container_of(work, struct rt5514_dsp, adc_work.work);
+	struct rt5514_stream *stream =
+		container_of(work, struct rt5514_stream, arm_work.work);
 	struct snd_card *card;
 
-	if (rt5514_dsp->substream[2] && rt5514_dsp->substream[2]->pcm)
-		card = rt5514_dsp->substream[2]->pcm->card;
+	if (stream->substream && stream->substream->pcm)
+		card = stream->substream->pcm->card;
 	else
 		return;
 
-	if (!snd_power_wait(card, SNDRV_CTL_POWER_D0))
-		rt5514_schedule_copy(rt5514_dsp, true);
+	if (snd_power_wait(card, SNDRV_CTL_POWER_D0))
+		return;
+
+	mutex_lock(&stream->dsp->dma_lock);
+	stream->stream_flag = stream->desc->stream_flag;
+	mutex_unlock(&stream->dsp->dma_lock);
+
+	rt5514_spi_stream_start(stream, !stream->continuous);
 }
 
 static irqreturn_t rt5514_spi_irq(int irq, void *data)
@@ -849,7 +1280,7 @@ static irqreturn_t rt5514_spi_irq(int irq, void *data)
 
 	pm_wakeup_event(rt5514_dsp->dev, 5000);
 	cancel_delayed_work_sync(&rt5514_dsp->start_work);
-	schedule_delayed_work(&rt5514_dsp->start_work, msecs_to_jiffies(0));
+	schedule_delayed_work(&rt5514_dsp->start_work, 0);
 
 	return IRQ_HANDLED;
 }
@@ -870,17 +1301,23 @@ static int rt5514_spi_hw_params(struct snd_pcm_substream *substream,
 	struct snd_soc_component *component = snd_soc_rtdcom_lookup(rtd, DRV_NAME);
 	struct rt5514_dsp *rt5514_dsp =
 		snd_soc_component_get_drvdata(component);
+	struct rt5514_stream *stream = &rt5514_dsp->stream[cpu_dai->id];
 	int ret;
 
 	mutex_lock(&rt5514_dsp->dma_lock);
-	ret = snd_pcm_lib_alloc_vmalloc_buffer(substream,
-			params_buffer_bytes(hw_params));
-	rt5514_dsp->substream[cpu_dai->id] = substream;
-	rt5514_dsp->dma_offset[cpu_dai->id] = 0;
+	if (rt5514_dsp->pcm_dma_buffer)
+		ret = snd_pcm_lib_malloc_pages(substream,
+				params_buffer_bytes(hw_params));
+	else
+		ret = snd_pcm_lib_alloc_vmalloc_buffer(substream,
+				params_buffer_bytes(hw_params));
+	stream->substream = substream;
+	stream->dma_offset = 0;
+	stream->continuous = stream->desc->continuous &&
+		stream->continuous_req;
 
-	if (cpu_dai->id == 2)
-		schedule_delayed_work(&rt5514_dsp->adc_work,
-			msecs_to_jiffies(0));
+	if (!stream->desc->irq_flag || stream->continuous)
+		schedule_delayed_work(&stream->arm_work, 0);
 
 	mutex_unlock(&rt5514_dsp->dma_lock);
 
@@ -894,30 +1331,22 @@ static int rt5514_spi_hw_free(struct snd_pcm_substream *substream)
 	struct snd_soc_component *component = snd_soc_rtdcom_lookup(rtd, DRV_NAME);
 	struct rt5514_dsp *rt5514_dsp =
 		snd_soc_component_get_drvdata(component);
+	struct rt5514_stream *stream = &rt5514_dsp->stream[cpu_dai->id];
 
 	mutex_lock(&rt5514_dsp->dma_lock);
-	rt5514_dsp->substream[cpu_dai->id] = NULL;
+	stream->substream = NULL;
+	stream->wm_bytes = 0;
 	mutex_unlock(&rt5514_dsp->dma_lock);
 
-	switch (cpu_dai->id) {
-	case 1:
-		cancel_delayed_work_sync(&rt5514_dsp->copy_work_1);
-		break;
+	cancel_delayed_work_sync(&stream->arm_work);
+	hrtimer_cancel(&stream->poll_timer);
+	kthread_cancel_delayed_work_sync(&stream->copy_work);
 
-	case 2:
-		cancel_delayed_work_sync(&rt5514_dsp->copy_work_2);
-		break;
+	stream->stream_flag = RT5514_DSP_NO_STREAM;
+	stream->continuous = false;
 
-	case 3:
-		cancel_delayed_work_sync(&rt5514_dsp->copy_work_3);
-		break;
-
-	default:
-		cancel_delayed_work_sync(&rt5514_dsp->copy_work_0);
-		break;
-	}
-
-	rt5514_dsp->stream_flag[cpu_dai->id] = RT5514_DSP_NO_STREAM;
+	if (rt5514_dsp->pcm_dma_buffer)
+		return snd_pcm_lib_free_pages(substream);
 
 	return snd_pcm_lib_free_vmalloc_buffer(substream);
 }
@@ -932,7 +1361,22 @@ static snd_pcm_uframes_t rt5514_spi_pcm_pointer(
 	struct rt5514_dsp *rt5514_dsp =
 		snd_soc_component_get_drvdata(component);
 
-	return bytes_to_frames(runtime, rt5514_dsp->dma_offset[cpu_dai->id]);
+	return bytes_to_frames(runtime,
+		rt5514_dsp->stream[cpu_dai->id].dma_offset);
+}
+
+static struct page *rt5514_spi_pcm_page(struct snd_pcm_substream *substream,
+		unsigned long offset)
+{
+	struct snd_soc_pcm_runtime *rtd = substream->private_data;
+	struct snd_soc_component *component = snd_soc_rtdcom_lookup(rtd, DRV_NAME);
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
+
+	if (rt5514_dsp->pcm_dma_buffer)
+		return virt_to_page(substream->runtime->dma_area + offset);
+
+	return snd_pcm_lib_get_vmalloc_page(substream, offset);
 }
 
 static const struct snd_pcm_ops rt5514_spi_pcm_ops = {
@@ -940,51 +1384,94 @@ static const struct snd_pcm_ops rt5514_spi_pcm_ops = {
 	.hw_params	= rt5514_spi_hw_params,
 	.hw_free	= rt5514_spi_hw_free,
 	.pointer	= rt5514_spi_pcm_pointer,
-	.page		= snd_pcm_lib_get_vmalloc_page,
+	.page		= rt5514_spi_pcm_page,
 };
 
+/*
+ * With "realtek,pcm-dma-buffer" the PCM buffers are physically contiguous
+ * lowmem pages instead of vmalloc memory, so the SPI controller can DMA the
+ * DSP data straight into the period being filled.
+ */
+static int rt5514_spi_pcm_new(struct snd_soc_pcm_runtime *rtd)
+{
+	struct snd_soc_component *component = snd_soc_rtdcom_lookup(rtd, DRV_NAME);
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
+
+	if (!rt5514_dsp->pcm_dma_buffer)
+		return 0;
+
+	return snd_pcm_lib_preallocate_pages_for_all(rtd->pcm,
+		SNDRV_DMA_TYPE_CONTINUOUS, snd_dma_continuous_data(GFP_KERNEL),
+		rt5514_spi_pcm_hardware.buffer_bytes_max,
+		rt5514_spi_pcm_hardware.buffer_bytes_max);
+}
+
 static int rt5514_pcm_parse_dp(struct rt5514_dsp *rt5514_dsp,
 	struct device *dev)
 {
-	device_property_read_u32(dev, "realtek,musdet-ignore-ms",
-		&rt5514_dsp->musdet_ignore_ms);
-	device_property_read_u32(dev, "realtek,hotword-ignore-ms",
-		&rt5514_dsp->hotword_ignore_ms);
-	device_property_read_u32(dev, "realtek,musdet-brk-ignore-ms",
-		&rt5514_dsp->musdet_brk_ignore_ms);
+	struct rt5514_stream *stream;
+	unsigned int i;
+
+	for (i = 0; i < RT5514_STREAM_NUM; i++) {
+		stream = &rt5514_dsp->stream[i];
+		if (stream->desc->ignore_ms_prop)
+			device_property_read_u32(dev,
+				stream->desc->ignore_ms_prop,
+				&stream->ignore_ms);
+		if (stream->desc->continuous_prop)
+			stream->continuous_req = device_property_read_bool(dev,
+				stream->desc->continuous_prop);
+	}
+
+	rt5514_dsp->pcm_dma_buffer = device_property_read_bool(dev,
+		"realtek,pcm-dma-buffer");
 
 	return 0;
 }
 
+/*
+ * Set up the stream works at SPI probe, as rt5514_spi_put_dsp() may have to
+ * cancel them before the component was ever probed.
+ */
+static void rt5514_spi_init_streams(struct rt5514_dsp *rt5514_dsp)
+{
+	struct rt5514_stream *stream;
+	unsigned int i;
+
+	for (i = 0; i < RT5514_STREAM_NUM; i++) {
+		stream = &rt5514_dsp->stream[i];
+		stream->desc = &rt5514_stream_descs[i];
+		stream->dsp = rt5514_dsp;
+		stream->id = i;
+		kthread_init_delayed_work(&stream->copy_work,
+			rt5514_spi_copy_work);
+		INIT_DELAYED_WORK(&stream->arm_work, rt5514_spi_arm_work);
+		hrtimer_init(&stream->poll_timer, CLOCK_MONOTONIC,
+			HRTIMER_MODE_REL);
+		stream->poll_timer.function = rt5514_spi_poll_timer;
+	}
+
+	INIT_DELAYED_WORK(&rt5514_dsp->start_work, rt5514_spi_start_work);
+}
+
 static int rt5514_spi_pcm_probe(struct snd_soc_component *component)
 {
-	struct rt5514_dsp *rt5514_dsp;
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
 	int ret;
 
-	rt5514_dsp = devm_kzalloc(component->dev, sizeof(*rt5514_dsp),
-			GFP_KERNEL);
-	g_rt5514_dsp = rt5514_dsp;
+	rt5514_pcm_parse_dp(rt5514_dsp, rt5514_dsp->dev);
 
-	rt5514_pcm_parse_dp(rt5514_dsp, &rt5514_spi->dev);
-
-	rt5514_dsp->dev = &rt5514_spi->dev;
 	rt5514_dsp->component = component;
-	mutex_init(&rt5514_dsp->dma_lock);
-	INIT_DELAYED_WORK(&rt5514_dsp->copy_work_0, rt5514_spi_copy_work_0);
-	INIT_DELAYED_WORK(&rt5514_dsp->copy_work_1, rt5514_spi_copy_work_1);
-	INIT_DELAYED_WORK(&rt5514_dsp->copy_work_2, rt5514_spi_copy_work_2);
-	INIT_DELAYED_WORK(&rt5514_dsp->copy_work_3, rt5514_spi_copy_work_3);
-	INIT_DELAYED_WORK(&rt5514_dsp->start_work, rt5514_spi_start_work);
-	INIT_DELAYED_WORK(&rt5514_dsp->adc_work, rt5514_spi_adc_start);
-	snd_soc_component_set_drvdata(component, rt5514_dsp);
 
-	if (rt5514_spi->irq) {
-		ret = devm_request_threaded_irq(&rt5514_spi->dev,
-			rt5514_spi->irq, NULL, rt5514_spi_irq,
+	if (rt5514_dsp->spi->irq) {
+		ret = devm_request_threaded_irq(rt5514_dsp->dev,
+			rt5514_dsp->spi->irq, NULL, rt5514_spi_irq,
 			IRQF_TRIGGER_RISING | IRQF_ONESHOT, "rt5514-spi",
 			rt5514_dsp);
 		if (ret)
-			dev_err(&rt5514_spi->dev,
+			dev_err(rt5514_dsp->dev,
 				"%s Failed to reguest IRQ: %d\n", __func__,
 				ret);
 	}
@@ -992,37 +1479,437 @@ static int rt5514_spi_pcm_probe(struct snd_soc_component *component)
 	return 0;
 }
 
+static int rt5514_spi_overruns_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+		(struct soc_mixer_control *)kcontrol->private_value;
+
+	ucontrol->value.integer.value[0] =
+		rt5514_dsp->stream[mc->shift].overruns;
+
+	return 0;
+}
+
+/* Writing 0 clears the counter */
+static int rt5514_spi_overruns_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+		(struct soc_mixer_control *)kcontrol->private_value;
+
+	if (ucontrol->value.integer.value[0])
+		return -EINVAL;
+
+	rt5514_dsp->stream[mc->shift].overruns = 0;
+
+	return 0;
+}
+
+static int rt5514_spi_continuous_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+		(struct soc_mixer_control *)kcontrol->private_value;
+
+	ucontrol->value.integer.value[0] =
+		rt5514_dsp->stream[mc->shift].continuous_req;
+
+	return 0;
+}
+
+/* Takes effect when the stream is next set up */
+static int rt5514_spi_continuous_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5514_dsp *rt5514_dsp =
+		snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+		(struct soc_mixer_control *)kcontrol->private_value;
+	struct rt5514_stream *stream = &rt5514_dsp->stream[mc->shift];
+
+	if (!stream->desc->continuous)
+		return -EINVAL;
+
+	stream->continuous_req = !!ucontrol->value.integer.value[0];
+
+	return 0;
+}
+
+static const struct snd_kcontrol_new rt5514_spi_snd_controls[] = {
+	SOC_SINGLE_EXT("DSP Hotword Continuous", SND_SOC_NOPM, 0, 1, 0,
+		rt5514_spi_continuous_get, rt5514_spi_continuous_put),
+	SOC_SINGLE_EXT("DSP Hotword Overruns", SND_SOC_NOPM, 0, INT_MAX, 0,
+		rt5514_spi_overruns_get, rt5514_spi_overruns_put),
+	SOC_SINGLE_EXT("DSP Music Detect Overruns", SND_SOC_NOPM, 1, INT_MAX,
+		0, rt5514_spi_overruns_get, rt5514_spi_overruns_put),
+	SOC_SINGLE_EXT("DSP ADC Overruns", SND_SOC_NOPM, 2, INT_MAX, 0,
+		rt5514_spi_overruns_get, rt5514_spi_overruns_put),
+	SOC_SINGLE_EXT("DSP Music Detect Break Overruns", SND_SOC_NOPM, 3,
+		INT_MAX, 0, rt5514_spi_overruns_get, rt5514_spi_overruns_put),
+};
+
 static struct snd_soc_component_driver rt5514_spi_component = {
 	.name  = DRV_NAME,
 	.probe = rt5514_spi_pcm_probe,
+	.controls = rt5514_spi_snd_controls,
+	.num_controls = ARRAY_SIZE(rt5514_spi_snd_controls),
 	.ops = &rt5514_spi_pcm_ops,
+	.pcm_new = rt5514_spi_pcm_new,
 };
 
-/**
- * rt5514_spi_burst_read - Read data from SPI by rt5514 address.
- * @addr: Start address.
- * @rxbuf: Data Buffer for reading.
- * @len: Data length, it must be a multiple of 8.
- *
- *
- * Returns true for success.
+/*
+ * The DSP memory is accessed as 64-bit words sent most significant byte
+ * first, so every 8-byte group is byte reversed between host and wire order.
+ * Convert @len bytes (whole groups only) from @src into @dst, one 64-bit word
+ * per step; @dst may be equal to @src and neither needs to be aligned.
  */
-int rt5514_spi_burst_read(unsigned int addr, u8 *rxbuf, size_t len)
+static void rt5514_spi_copy_swab64(u8 *dst, const u8 *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+		put_unaligned_le64(get_unaligned_be64(src + i), dst + i);
+}
+
+/*
+ * The DSP SRAM (0x4fexxxxx) takes bursts at the full SPI rate of the chip,
+ * while the 0x18xxxxxx register window needs a safe clock. 0 keeps the
+ * max_speed_hz of the device.
+ */
+static u32 rt5514_spi_speed(struct rt5514_dsp *rt5514_dsp, unsigned int addr)
+{
+	if ((addr & 0xffe00000) == 0x4fe00000)
+		return rt5514_dsp->sram_speed_hz;
+
+	return rt5514_dsp->reg_speed_hz;
+}
+
+/*
+ * Account a finished message to the statistics of the caller class holding
+ * spi_lock.
+ */
+static void rt5514_spi_account(struct rt5514_dsp *rt5514_dsp,
+	struct spi_message *message, ktime_t start, ktime_t end, int status)
+{
+	struct rt5514_spi_stats *stats = &rt5514_dsp->stats;
+	struct spi_transfer *x;
+	s64 us = ktime_us_delta(end, start);
+	unsigned int bin = 0;
+
+	if (us > 0)
+		bin = min_t(unsigned int, ilog2(us) + 1,
+			RT5514_SPI_LAT_BINS - 1);
+
+	spin_lock(&rt5514_dsp->stats_lock);
+
+	stats->messages++;
+	if (status)
+		stats->errors++;
+
+	list_for_each_entry(x, &message->transfers, transfer_list) {
+		if (x->rx_buf)
+			stats->bytes_read += x->len;
+		if (x->tx_buf)
+			stats->bytes_written += x->len;
+	}
+
+	stats->latency[rt5514_dsp->cur_class][bin]++;
+
+	spin_unlock(&rt5514_dsp->stats_lock);
+}
+
+static int rt5514_spi_sync(struct rt5514_dsp *rt5514_dsp,
+	struct spi_message *message)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	if (rt5514_spi_bus_owned(rt5514_dsp))
+		ret = spi_sync_locked(rt5514_dsp->spi, message);
+	else
+		ret = spi_sync(rt5514_dsp->spi, message);
+
+	rt5514_spi_account(rt5514_dsp, message, start, ktime_get(), ret);
+
+	return ret;
+}
+
+static int rt5514_spi_sync_transfer(struct rt5514_dsp *rt5514_dsp,
+	struct spi_transfer *xfers, unsigned int num_xfers)
 {
-	u8 spi_cmd = RT5514_SPI_CMD_BURST_READ;
-	int status;
-	u8 write_buf[8];
-	unsigned int i, end, offset = 0;
 	struct spi_message message;
-	struct spi_transfer x[3];
 
-	mutex_lock(&spi_lock);
+	spi_message_init_with_transfers(&message, xfers, num_xfers);
 
-	while (offset < len) {
-		if (offset + RT5514_SPI_BUF_LEN <= len)
-			end = RT5514_SPI_BUF_LEN;
+	return rt5514_spi_sync(rt5514_dsp, &message);
+}
+
+static int rt5514_spi_async(struct rt5514_dsp *rt5514_dsp,
+	struct spi_message *message)
+{
+	if (rt5514_spi_bus_owned(rt5514_dsp))
+		return spi_async_locked(rt5514_dsp->spi, message);
+
+	return spi_async(rt5514_dsp->spi, message);
+}
+
+static void rt5514_spi_batch_complete(void *context)
+{
+	struct rt5514_spi_batch *batch = context;
+
+	batch->end = ktime_get();
+	complete(&batch->done);
+}
+
+/*
+ * Build one spi_message with up to msg_chunks chunks, each chunk
+ * with its own command/dummy/data transfers and a chip select toggle in
+ * between. In long burst mode an SRAM read sends the header once and keeps
+ * the chip select asserted across the data transfers of the message, which
+ * the DSP serves with its address auto-increment. Returns the number of
+ * bytes the message covers.
+ */
+static size_t rt5514_spi_batch_prepare(struct rt5514_dsp *rt5514_dsp,
+	struct rt5514_spi_batch *batch, unsigned int addr, u8 *rxbuf, size_t len)
+{
+	u8 spi_cmd = RT5514_SPI_CMD_BURST_READ;
+	unsigned int n, end, offset = 0, align;
+	u32 speed_hz = rt5514_spi_speed(rt5514_dsp, addr);
+	bool long_burst = rt5514_dsp->long_burst &&
+		(addr & 0xffe00000) == 0x4fe00000;
+	struct spi_transfer *x = batch->x;
+	u8 *header;
+
+	/*
+	 * If another batch follows, end this one on a cache line boundary so
+	 * that swapping it never touches a line the next batch is receiving.
+	 * When the boundary is not a whole number of groups away, the batch
+	 * is marked so it is swapped before the next one is queued.
+	 */
+	batch->tail_shared = false;
+	if (len > rt5514_dsp->msg_chunks * rt5514_dsp->buf_len) {
+		len = rt5514_dsp->msg_chunks * rt5514_dsp->buf_len;
+		align = (unsigned long)(rxbuf + len) % dma_get_cache_alignment();
+		if (!(align % 8) && align < len)
+			len -= align;
+		else if (align)
+			batch->tail_shared = true;
+	}
+
+	spi_message_init(&batch->message);
+	memset(batch->x, 0, sizeof(batch->x));
+
+	for (n = 0; offset < len; n++) {
+		if (offset + rt5514_dsp->buf_len <= len)
+			end = rt5514_dsp->buf_len;
 		else
-			end = len % RT5514_SPI_BUF_LEN;
+			end = len - offset;
+
+		if (!long_burst || !n) {
+			header = batch->cmd_buf + n * 8;
+			header[0] = spi_cmd;
+			header[1] = ((addr + offset) & 0xff000000) >> 24;
+			header[2] = ((addr + offset) & 0x00ff0000) >> 16;
+			header[3] = ((addr + offset) & 0x0000ff00) >> 8;
+			header[4] = ((addr + offset) & 0x000000ff) >> 0;
+
+			x->len = 5;
+			x->tx_buf = header;
+			x->speed_hz = speed_hz;
+			spi_message_add_tail(x++, &batch->message);
+
+			x->len = 4;
+			x->tx_buf = header;
+			x->speed_hz = speed_hz;
+			spi_message_add_tail(x++, &batch->message);
+		}
+
+		x->len = end;
+		x->rx_buf = rxbuf + offset;
+		x->speed_hz = speed_hz;
+		x->cs_change = !long_burst;
+		spi_message_add_tail(x++, &batch->message);
+
+		offset += end;
+	}
+
+	/* Release the chip select at the end of the message */
+	x[-1].cs_change = 0;
+
+	batch->message.complete = rt5514_spi_batch_complete;
+	batch->message.context = batch;
+	batch->rxbuf = rxbuf;
+	batch->len = len;
+	reinit_completion(&batch->done);
+
+	return len;
+}
+
+static void rt5514_spi_count_retry(struct rt5514_dsp *rt5514_dsp)
+{
+	spin_lock(&rt5514_dsp->stats_lock);
+	rt5514_dsp->stats.retries++;
+	spin_unlock(&rt5514_dsp->stats_lock);
+}
+
+/*
+ * Wait for a batch and byte swap it. A failed batch is resent on its own,
+ * up to RT5514_SPI_XFER_RETRY times, without touching the other batch.
+ */
+static int rt5514_spi_batch_finish(struct rt5514_dsp *rt5514_dsp,
+	struct rt5514_spi_batch *batch)
+{
+	int status, i;
+
+	wait_for_completion(&batch->done);
+
+	status = batch->message.status;
+	rt5514_spi_account(rt5514_dsp, &batch->message, batch->start,
+		batch->end, status);
+
+	for (i = 0; status && i < RT5514_SPI_XFER_RETRY; i++) {
+		rt5514_spi_count_retry(rt5514_dsp);
+		status = rt5514_spi_sync(rt5514_dsp, &batch->message);
+	}
+
+	if (status)
+		return status;
+
+	rt5514_spi_copy_swab64(batch->rxbuf, batch->rxbuf, batch->len);
+
+	return 0;
+}
+
+/*
+ * Read whole 8-byte groups starting at an 8-byte aligned address. The
+ * read is split into messages of up to msg_chunks chunks that are
+ * submitted with spi_async() from two alternating batches, so the next
+ * message is on the wire while the previous one is being byte swapped.
+ * With @preempt the lock is yielded to stream readers between messages.
+ * The number of bytes read before a failure is stored in @done. The
+ * caller must hold spi_lock.
+ */
+static int __rt5514_spi_burst_read(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, u8 *rxbuf, size_t len, bool preempt, size_t *done)
+{
+	struct rt5514_spi_batch *batch, *prev = NULL;
+	size_t offset = 0, completed = 0;
+	unsigned int n = 0;
+	int status = 0, ret;
+
+	while (offset < len && !status) {
+		/* Let waiting stream readers in between two messages */
+		if (preempt && prev &&
+			atomic_read(&rt5514_dsp->stream_waiters)) {
+			status = rt5514_spi_batch_finish(rt5514_dsp, prev);
+			if (!status)
+				completed += prev->len;
+			prev = NULL;
+			if (status)
+				break;
+
+			rt5514_spi_yield(rt5514_dsp);
+		}
+
+		/* Do not DMA into a line the CPU is about to swap */
+		if (prev && prev->tail_shared) {
+			status = rt5514_spi_batch_finish(rt5514_dsp, prev);
+			if (!status)
+				completed += prev->len;
+			prev = NULL;
+			if (status)
+				break;
+		}
+
+		batch = &rt5514_dsp->bufs->batch[n++ & 1];
+		offset += rt5514_spi_batch_prepare(rt5514_dsp, batch,
+			addr + offset, rxbuf + offset, len - offset);
+
+		batch->start = ktime_get();
+		ret = rt5514_spi_async(rt5514_dsp, &batch->message);
+		if (ret) {
+			/* Leave it to rt5514_spi_batch_finish() to resend */
+			batch->message.status = ret;
+			batch->end = ktime_get();
+			complete(&batch->done);
+		}
+
+		/* Swap the previous batch while this one is on the wire */
+		if (prev) {
+			status = rt5514_spi_batch_finish(rt5514_dsp, prev);
+			if (!status)
+				completed += prev->len;
+		}
+		prev = batch;
+	}
+
+	if (prev) {
+		ret = rt5514_spi_batch_finish(rt5514_dsp, prev);
+		if (!status) {
+			status = ret;
+			if (!ret)
+				completed += prev->len;
+		}
+	}
+
+	if (done)
+		*done = completed;
+
+	return status;
+}
+
+/*
+ * Send one burst write chunk, resending it up to RT5514_SPI_XFER_RETRY
+ * times. The caller must hold spi_lock.
+ */
+static int rt5514_spi_write_chunk(struct rt5514_dsp *rt5514_dsp,
+	struct spi_transfer *x)
+{
+	int ret, i;
+
+	ret = rt5514_spi_sync_transfer(rt5514_dsp, x, 1);
+	for (i = 0; ret && i < RT5514_SPI_XFER_RETRY; i++) {
+		rt5514_spi_count_retry(rt5514_dsp);
+		ret = rt5514_spi_sync_transfer(rt5514_dsp, x, 1);
+	}
+
+	return ret;
+}
+
+/*
+ * Write whole 8-byte groups starting at an 8-byte aligned address. With
+ * @preempt the lock is yielded to stream readers between chunks. The
+ * number of bytes written before a failure is stored in @done. The caller
+ * must hold spi_lock.
+ */
+static int __rt5514_spi_burst_write(struct rt5514_dsp *rt5514_dsp, u32 addr,
+	const u8 *txbuf, size_t len, bool preempt, size_t *done)
+{
+	u8 spi_cmd = RT5514_SPI_CMD_BURST_WRITE;
+	u8 *write_buf = rt5514_dsp->tx_buf;
+	unsigned int end, offset = 0;
+	struct spi_transfer x = {
+		.tx_buf = write_buf,
+		.speed_hz = rt5514_spi_speed(rt5514_dsp, addr),
+	};
+	int ret = 0;
+
+	while (offset < len) {
+		if (preempt && offset)
+			rt5514_spi_yield(rt5514_dsp);
+
+		end = min_t(size_t, len - offset, rt5514_dsp->buf_len);
 
 		write_buf[0] = spi_cmd;
 		write_buf[1] = ((addr + offset) & 0xff000000) >> 24;
@@ -1030,131 +1917,276 @@ int rt5514_spi_burst_read(unsigned int addr, u8 *rxbuf, size_t len)
 		write_buf[3] = ((addr + offset) & 0x0000ff00) >> 8;
 		write_buf[4] = ((addr + offset) & 0x000000ff) >> 0;
 
-		spi_message_init(&message);
-		memset(x, 0, sizeof(x));
+		rt5514_spi_copy_swab64(write_buf + 5, txbuf + offset, end);
 
-		x[0].len = 5;
-		x[0].tx_buf = write_buf;
-		spi_message_add_tail(&x[0], &message);
+		write_buf[end + 5] = spi_cmd;
 
-		x[1].len = 4;
-		x[1].tx_buf = write_buf;
-		spi_message_add_tail(&x[1], &message);
+		x.len = end + 6;
+		ret = rt5514_spi_write_chunk(rt5514_dsp, &x);
+		if (ret)
+			break;
 
-		x[2].len = end;
-		x[2].rx_buf = rxbuf + offset;
-		spi_message_add_tail(&x[2], &message);
+		offset += end;
+	}
+
+	if (done)
+		*done = offset;
+
+	return ret;
+}
 
-		status = spi_sync(rt5514_spi, &message);
+/*
+ * Read any range. A partial group at either end is read whole into a
+ * bounce buffer and only the requested bytes are copied out. Destinations
+ * on the stack cannot be DMA mapped and go through the bounce buffer one
+ * group at a time. Stream reads go ahead of bulk transfers waiting for the
+ * lock and are not preempted. The number of bytes read before a failure is
+ * stored in @done.
+ */
+static int rt5514_spi_read_range(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, u8 *rxbuf, size_t len, enum rt5514_spi_class class,
+	size_t *done)
+{
+	bool stream = class == RT5514_SPI_CLASS_STREAM;
+	unsigned int head = addr & 7;
+	size_t n, completed = 0;
+	int status = 0;
 
-		if (status) {
-			mutex_unlock(&spi_lock);
-			return false;
+	if (stream)
+		rt5514_spi_lock_stream(rt5514_dsp);
+	else
+		rt5514_spi_lock(rt5514_dsp, class);
+
+	if (head && len) {
+		n = min_t(size_t, 8 - head, len);
+		status = __rt5514_spi_burst_read(rt5514_dsp, addr - head,
+			rt5514_dsp->bufs->rmw, 8, false, NULL);
+		if (!status) {
+			memcpy(rxbuf, rt5514_dsp->bufs->rmw + head, n);
+			completed = n;
 		}
+	}
 
-		offset += RT5514_SPI_BUF_LEN;
+	n = round_down(len - completed, 8);
+	if (n && !status && !object_is_on_stack(rxbuf)) {
+		status = __rt5514_spi_burst_read(rt5514_dsp, addr + completed,
+			rxbuf + completed, n, !stream, &n);
+		completed += n;
 	}
 
-	for (i = 0; i < len; i += 8) {
-		write_buf[0] = rxbuf[i + 0];
-		write_buf[1] = rxbuf[i + 1];
-		write_buf[2] = rxbuf[i + 2];
-		write_buf[3] = rxbuf[i + 3];
-		write_buf[4] = rxbuf[i + 4];
-		write_buf[5] = rxbuf[i + 5];
-		write_buf[6] = rxbuf[i + 6];
-		write_buf[7] = rxbuf[i + 7];
-
-		rxbuf[i + 0] = write_buf[7];
-		rxbuf[i + 1] = write_buf[6];
-		rxbuf[i + 2] = write_buf[5];
-		rxbuf[i + 3] = write_buf[4];
-		rxbuf[i + 4] = write_buf[3];
-		rxbuf[i + 5] = write_buf[2];
-		rxbuf[i + 6] = write_buf[1];
-		rxbuf[i + 7] = write_buf[0];
+	while (completed < len && !status) {
+		n = min_t(size_t, len - completed, 8);
+		status = __rt5514_spi_burst_read(rt5514_dsp, addr + completed,
+			rt5514_dsp->bufs->rmw, 8, false, NULL);
+		if (!status) {
+			memcpy(rxbuf + completed, rt5514_dsp->bufs->rmw, n);
+			completed += n;
+		}
 	}
 
-	mutex_unlock(&spi_lock);
-	return true;
+	rt5514_spi_unlock(rt5514_dsp);
+
+	if (done)
+		*done = completed;
+
+	return status;
+}
+
+/**
+ * rt5514_spi_burst_read - Read data from SPI by rt5514 address.
+ * @rt5514_dsp: The DSP instance.
+ * @addr: Start address.
+ * @rxbuf: Data Buffer for reading.
+ * @len: Data length.
+ * @class: Who the read is for, for the latency statistics.
+ * @done: Optional, set to the number of bytes read from @addr on.
+ *
+ * The address and length do not need to be 8-byte aligned. The read gives
+ * way to the PCM stream readers between messages, and a failed message is
+ * resent on its own before the read gives up.
+ *
+ * Returns 0 for success or a negative error code.
+ */
+int rt5514_spi_burst_read(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	u8 *rxbuf, size_t len, enum rt5514_spi_class class, size_t *done)
+{
+	return rt5514_spi_read_range(rt5514_dsp, addr, rxbuf, len, class,
+		done);
 }
 EXPORT_SYMBOL_GPL(rt5514_spi_burst_read);
 
+/*
+ * Write less than a group within a single 8-byte group by reading the group
+ * back and merging the new bytes. The caller must hold spi_lock.
+ */
+static int __rt5514_spi_write_partial(struct rt5514_dsp *rt5514_dsp, u32 addr,
+	const u8 *txbuf, size_t len)
+{
+	unsigned int head = addr & 7;
+	int ret;
+
+	ret = __rt5514_spi_burst_read(rt5514_dsp, addr - head,
+		rt5514_dsp->bufs->rmw, 8, false, NULL);
+	if (ret)
+		return ret;
+
+	memcpy(rt5514_dsp->bufs->rmw + head, txbuf, len);
+
+	return __rt5514_spi_burst_write(rt5514_dsp, addr - head,
+		rt5514_dsp->bufs->rmw, 8, false, NULL);
+}
+
 /**
  * rt5514_spi_burst_write - Write data to SPI by rt5514 address.
+ * @rt5514_dsp: The DSP instance.
  * @addr: Start address.
  * @txbuf: Data Buffer for writng.
- * @len: Data length, it must be a multiple of 8.
+ * @len: Data length.
+ * @class: Who the write is for, for the latency statistics.
+ * @done: Optional, set to the number of bytes written from @addr on.
  *
+ * The address and length do not need to be 8-byte aligned: a partial
+ * group at either end is read back, merged with the new bytes and
+ * written whole, so the DSP memory around the range is left untouched.
+ * The write gives way to the PCM stream readers between chunks, and a
+ * failed chunk is resent on its own before the write gives up. On failure
+ * the caller can resume from @addr + @done.
  *
- * Returns true for success.
+ * Returns 0 for success or a negative error code.
  */
-int rt5514_spi_burst_write(u32 addr, const u8 *txbuf, size_t len)
+int rt5514_spi_burst_write(struct rt5514_dsp *rt5514_dsp, u32 addr,
+	const u8 *txbuf, size_t len, enum rt5514_spi_class class, size_t *done)
 {
-	u8 spi_cmd = RT5514_SPI_CMD_BURST_WRITE;
-	u8 *write_buf;
-	unsigned int i, j, end, offset = 0;
+	unsigned int head = addr & 7;
+	size_t n, completed = 0;
+	int ret = 0;
 
-	mutex_lock(&spi_lock);
+	rt5514_spi_lock(rt5514_dsp, class);
 
-	write_buf = kmalloc(RT5514_SPI_BUF_LEN + 6, GFP_KERNEL);
+	if (head && len) {
+		n = min_t(size_t, 8 - head, len);
+		ret = __rt5514_spi_write_partial(rt5514_dsp, addr, txbuf, n);
+		if (!ret)
+			completed = n;
+	}
 
-	if (write_buf == NULL) {
-		mutex_unlock(&spi_lock);
-		return -ENOMEM;
+	n = round_down(len - completed, 8);
+	if (n && !ret) {
+		ret = __rt5514_spi_burst_write(rt5514_dsp, addr + completed,
+			txbuf + completed, n, true, &n);
+		completed += n;
 	}
 
-	while (offset < len) {
-		if (offset + RT5514_SPI_BUF_LEN <= len)
-			end = RT5514_SPI_BUF_LEN;
-		else
-			end = len % RT5514_SPI_BUF_LEN;
+	if (completed < len && !ret) {
+		ret = __rt5514_spi_write_partial(rt5514_dsp, addr + completed,
+			txbuf + completed, len - completed);
+		if (!ret)
+			completed = len;
+	}
 
-		write_buf[0] = spi_cmd;
-		write_buf[1] = ((addr + offset) & 0xff000000) >> 24;
-		write_buf[2] = ((addr + offset) & 0x00ff0000) >> 16;
-		write_buf[3] = ((addr + offset) & 0x0000ff00) >> 8;
-		write_buf[4] = ((addr + offset) & 0x000000ff) >> 0;
+	rt5514_spi_unlock(rt5514_dsp);
+
+	if (done)
+		*done = completed;
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rt5514_spi_burst_write);
 
-		for (i = 0; i < end; i += 8) {
-			for (j = 0; j < 8; j++) {
-				if ((offset + i + j) < len) {
-					write_buf[i + 12 - j] =
-						txbuf[offset + i + j];
-				} else {
-					break;
-				}
-			}
+/**
+ * rt5514_spi_fill - Fill DSP memory with a repeated 32-bit pattern.
+ * @rt5514_dsp: The DSP instance.
+ * @addr: Start address.
+ * @pattern: Pattern, stored little-endian and repeated from @addr on.
+ * @len: Data length.
+ * @class: Who the fill is for, for the latency statistics.
+ *
+ * The data part of the transfer buffer is filled with the byte swapped
+ * pattern once, and every chunk only rewrites the address header, so no
+ * host copy of the region is needed. The fill gives way to the PCM stream
+ * readers between chunks.
+ *
+ * Returns 0 for success or a negative error code.
+ */
+int rt5514_spi_fill(struct rt5514_dsp *rt5514_dsp, u32 addr, u32 pattern,
+	size_t len, enum rt5514_spi_class class)
+{
+	u8 spi_cmd = RT5514_SPI_CMD_BURST_WRITE;
+	u8 *write_buf = rt5514_dsp->tx_buf;
+	unsigned int head = addr & 7;
+	struct spi_transfer x = {
+		.tx_buf = write_buf,
+		.speed_hz = rt5514_spi_speed(rt5514_dsp, addr),
+	};
+	u8 group[8];
+	size_t n, end, done = 0;
+	bool primed = false;
+	unsigned int i;
+	int ret = 0;
+
+	rt5514_spi_lock(rt5514_dsp, class);
+
+	if (head && len) {
+		n = min_t(size_t, 8 - head, len);
+		for (i = 0; i < n; i++)
+			group[i] = pattern >> (8 * (i % 4));
+		ret = __rt5514_spi_write_partial(rt5514_dsp, addr, group, n);
+		done = n;
+	}
+
+	/* Every whole group of the aligned middle part looks the same */
+	for (i = 0; i < 8; i++)
+		group[i] = pattern >> (8 * ((done + i) % 4));
+
+	n = round_down(len - done, 8);
+	while (n && !ret) {
+		/* Others may have used the buffer while the lock was yielded */
+		if (primed && rt5514_spi_yield(rt5514_dsp))
+			primed = false;
+
+		if (!primed) {
+			for (i = 0; i < rt5514_dsp->buf_len; i += 8)
+				rt5514_spi_copy_swab64(write_buf + 5 + i,
+					group, 8);
+			primed = true;
 		}
 
-		if (end % 8)
-			end = (end / 8 + 1) * 8;
+		end = min_t(size_t, n, rt5514_dsp->buf_len);
 
+		write_buf[0] = spi_cmd;
+		write_buf[1] = ((addr + done) & 0xff000000) >> 24;
+		write_buf[2] = ((addr + done) & 0x00ff0000) >> 16;
+		write_buf[3] = ((addr + done) & 0x0000ff00) >> 8;
+		write_buf[4] = ((addr + done) & 0x000000ff) >> 0;
 		write_buf[end + 5] = spi_cmd;
 
-		spi_write(rt5514_spi, write_buf, end + 6);
+		x.len = end + 6;
+		ret = rt5514_spi_write_chunk(rt5514_dsp, &x);
 
-		offset += RT5514_SPI_BUF_LEN;
+		done += end;
+		n -= end;
 	}
 
-	kfree(write_buf);
+	if (done < len && !ret)
+		ret = __rt5514_spi_write_partial(rt5514_dsp, addr + done, group,
+			len - done);
 
-	mutex_unlock(&spi_lock);
-	return 0;
+	rt5514_spi_unlock(rt5514_dsp);
+
+	return ret;
 }
-EXPORT_SYMBOL_GPL(rt5514_spi_burst_write);
+EXPORT_SYMBOL_GPL(rt5514_spi_fill);
 
-int rt5514_spi_read(unsigned int addr, unsigned int *val)
+/* Read a 32-bit register, the caller must hold spi_lock */
+static int __rt5514_spi_read(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	unsigned int *val)
 {
-	struct spi_device *spi = rt5514_spi;
 	struct spi_message message;
 	struct spi_transfer x[3];
 	u8 spi_cmd = RT5514_SPI_CMD_32_READ;
 	int status;
-	u8 write_buf[5];
-	u8 read_buf[4];
-
-	mutex_lock(&spi_lock);
+	u8 *write_buf = rt5514_dsp->bufs->reg_tx;
+	u8 *read_buf = rt5514_dsp->bufs->reg_rx;
 
 	write_buf[0] = spi_cmd;
 	write_buf[1] = (addr & 0xff000000) >> 24;
@@ -1167,34 +2199,139 @@ int rt5514_spi_read(unsigned int addr, unsigned int *val)
 
 	x[0].len = 5;
 	x[0].tx_buf = write_buf;
+	x[0].speed_hz = rt5514_spi_speed(rt5514_dsp, addr);
 	spi_message_add_tail(&x[0], &message);
 
 	x[1].len = 4;
 	x[1].tx_buf = write_buf;
+	x[1].speed_hz = x[0].speed_hz;
 	spi_message_add_tail(&x[1], &message);
 
 	x[2].len = 4;
 	x[2].rx_buf = read_buf;
+	x[2].speed_hz = x[0].speed_hz;
 	spi_message_add_tail(&x[2], &message);
 
-	status = spi_sync(spi, &message);
+	status = rt5514_spi_sync(rt5514_dsp, &message);
 
 	*val = read_buf[3] | read_buf[2] << 8 | read_buf[1] << 16 |
 		read_buf[0] << 24;
 
-	mutex_unlock(&spi_lock);
+	return status;
+}
+
+int rt5514_spi_read(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	unsigned int *val)
+{
+	int status;
+
+	rt5514_spi_lock(rt5514_dsp, RT5514_SPI_CLASS_CTRL);
+	status = __rt5514_spi_read(rt5514_dsp, addr, val);
+	rt5514_spi_unlock(rt5514_dsp);
+
 	return status;
 }
 EXPORT_SYMBOL_GPL(rt5514_spi_read);
 
-int rt5514_spi_write(unsigned int addr, unsigned int val)
+/* Batch register reads, the caller must hold spi_lock */
+static int __rt5514_spi_read_multi(struct rt5514_dsp *rt5514_dsp,
+	const unsigned int *addrs, unsigned int *vals, unsigned int num)
+{
+	struct rt5514_spi_batch *batch = &rt5514_dsp->bufs->batch[0];
+	u8 *read_buf = rt5514_dsp->bufs->reg_rx_multi;
+	u8 spi_cmd = RT5514_SPI_CMD_32_READ;
+	unsigned int i, n, addr, done = 0;
+	int status = 0;
+	u8 *header;
+
+	while (done < num) {
+		spi_message_init(&batch->message);
+		memset(batch->x, 0, sizeof(batch->x));
+
+		for (n = 0; n < rt5514_dsp->reg_chunks && done + n < num; n++) {
+			addr = addrs[done + n];
+
+			header = batch->cmd_buf + n * 8;
+			header[0] = spi_cmd;
+			header[1] = (addr & 0xff000000) >> 24;
+			header[2] = (addr & 0x00ff0000) >> 16;
+			header[3] = (addr & 0x0000ff00) >> 8;
+			header[4] = (addr & 0x000000ff) >> 0;
+
+			batch->x[n * 3].len = 5;
+			batch->x[n * 3].tx_buf = header;
+			batch->x[n * 3].speed_hz =
+				rt5514_spi_speed(rt5514_dsp, addr);
+			spi_message_add_tail(&batch->x[n * 3], &batch->message);
+
+			batch->x[n * 3 + 1].len = 4;
+			batch->x[n * 3 + 1].tx_buf = header;
+			batch->x[n * 3 + 1].speed_hz = batch->x[n * 3].speed_hz;
+			spi_message_add_tail(&batch->x[n * 3 + 1],
+				&batch->message);
+
+			batch->x[n * 3 + 2].len = 4;
+			batch->x[n * 3 + 2].rx_buf = read_buf + n * 4;
+			batch->x[n * 3 + 2].speed_hz = batch->x[n * 3].speed_hz;
+			batch->x[n * 3 + 2].cs_change = 1;
+			spi_message_add_tail(&batch->x[n * 3 + 2],
+				&batch->message);
+		}
+
+		batch->x[n * 3 - 1].cs_change = 0;
+
+		status = rt5514_spi_sync(rt5514_dsp, &batch->message);
+		if (status)
+			break;
+
+		for (i = 0; i < n; i++)
+			vals[done + i] = get_unaligned_be32(read_buf + i * 4);
+
+		done += n;
+	}
+
+	return status;
+}
+
+/**
+ * rt5514_spi_read_multi - Read scattered 32-bit registers by rt5514 address.
+ * @rt5514_dsp: The DSP instance.
+ * @addrs: Register addresses.
+ * @vals: Buffer for the register values.
+ * @num: Number of registers.
+ *
+ * The RT5514_SPI_CMD_32_READ commands of as many registers as the SPI
+ * master controller takes in one spi_message, up to RT5514_SPI_MSG_CHUNKS,
+ * are packed into one spi_message, with a chip select toggle between
+ * registers.
+ *
+ * Returns 0 for success.
+ */
+int rt5514_spi_read_multi(struct rt5514_dsp *rt5514_dsp,
+	const unsigned int *addrs, unsigned int *vals, unsigned int num)
 {
-	struct spi_device *spi = rt5514_spi;
-	u8 spi_cmd = RT5514_SPI_CMD_32_WRITE;
 	int status;
-	u8 write_buf[10];
 
-	mutex_lock(&spi_lock);
+	rt5514_spi_lock(rt5514_dsp, RT5514_SPI_CLASS_CTRL);
+	status = __rt5514_spi_read_multi(rt5514_dsp, addrs, vals, num);
+	rt5514_spi_unlock(rt5514_dsp);
+
+	return status;
+}
+EXPORT_SYMBOL_GPL(rt5514_spi_read_multi);
+
+/* Write a 32-bit register, the caller must hold spi_lock */
+static int __rt5514_spi_write(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	unsigned int val)
+{
+	u8 spi_cmd = RT5514_SPI_CMD_32_WRITE;
+	int status;
+	u8 *write_buf = rt5514_dsp->bufs->reg_tx;
+	struct spi_transfer x = {
+		.tx_buf = write_buf,
+		.len = 10,
+		.speed_hz = rt5514_spi_speed(rt5514_dsp, addr),
+	};
 
 	write_buf[0] = spi_cmd;
 	write_buf[1] = (addr & 0xff000000) >> 24;
@@ -1207,22 +2344,423 @@ int rt5514_spi_write(unsigned int addr, unsigned int val)
 	write_buf[8] = (val & 0x000000ff) >> 0;
 	write_buf[9] = spi_cmd;
 
-	status = spi_write(spi, write_buf, sizeof(write_buf));
+	status = rt5514_spi_sync_transfer(rt5514_dsp, &x, 1);
 
 	if (status)
-		dev_err(&spi->dev, "%s error %d\n", __FUNCTION__, status);
+		dev_err(rt5514_dsp->dev, "%s error %d\n", __FUNCTION__, status);
+
+	return status;
+}
+
+int rt5514_spi_write(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	unsigned int val)
+{
+	int status;
+
+	rt5514_spi_lock(rt5514_dsp, RT5514_SPI_CLASS_CTRL);
+	status = __rt5514_spi_write(rt5514_dsp, addr, val);
+	rt5514_spi_unlock(rt5514_dsp);
 
-	mutex_unlock(&spi_lock);
 	return status;
 }
 EXPORT_SYMBOL_GPL(rt5514_spi_write);
 
+/*
+ * Register accesses on the trigger and copy paths, which go ahead of bulk
+ * transfers waiting for the lock like the ring reads do.
+ */
+static int rt5514_spi_stream_reg_read(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, unsigned int *val)
+{
+	int status;
+
+	rt5514_spi_lock_stream(rt5514_dsp);
+	status = __rt5514_spi_read(rt5514_dsp, addr, val);
+	rt5514_spi_unlock(rt5514_dsp);
+
+	return status;
+}
+
+static int rt5514_spi_stream_reg_write(struct rt5514_dsp *rt5514_dsp,
+	unsigned int addr, unsigned int val)
+{
+	int status;
+
+	rt5514_spi_lock_stream(rt5514_dsp);
+	status = __rt5514_spi_write(rt5514_dsp, addr, val);
+	rt5514_spi_unlock(rt5514_dsp);
+
+	return status;
+}
+
+static void rt5514_spi_free_bufs(void *data)
+{
+	struct rt5514_dsp *rt5514_dsp = data;
+
+	kfree(rt5514_dsp->tx_buf);
+	kfree(rt5514_dsp->bufs);
+}
+
+static int rt5514_spi_alloc_bufs(struct rt5514_dsp *rt5514_dsp)
+{
+	unsigned int i;
+
+	/*
+	 * kmalloc() rather than devm_kmalloc(), so the buffers start on an
+	 * ARCH_KMALLOC_MINALIGN boundary and can be mapped for DMA directly.
+	 */
+	rt5514_dsp->bufs = kzalloc(sizeof(*rt5514_dsp->bufs), GFP_KERNEL);
+	rt5514_dsp->tx_buf = kmalloc(rt5514_dsp->buf_len + 6, GFP_KERNEL);
+	if (!rt5514_dsp->bufs || !rt5514_dsp->tx_buf) {
+		rt5514_spi_free_bufs(rt5514_dsp);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(rt5514_dsp->bufs->batch); i++)
+		init_completion(&rt5514_dsp->bufs->batch[i].done);
+
+	return devm_add_action_or_reset(rt5514_dsp->dev, rt5514_spi_free_bufs,
+		rt5514_dsp);
+}
+
+static void rt5514_spi_destroy_worker(void *data)
+{
+	kthread_destroy_worker(data);
+}
+
+/*
+ * The copy works run on a dedicated kthread worker rather than the system
+ * workqueue, so draining the DSP rings does not queue behind other drivers
+ * or behind the slow stream start and watchdog handling.
+ * "realtek,stream-cpu" binds the worker to a CPU and
+ * "realtek,stream-fifo-priority" runs it SCHED_FIFO at that priority.
+ */
+static int rt5514_spi_create_worker(struct rt5514_dsp *rt5514_dsp)
+{
+	struct device *dev = rt5514_dsp->dev;
+	struct kthread_worker *worker;
+	struct sched_param param = { 0 };
+	u32 cpu, prio;
+	int ret;
+
+	if (!device_property_read_u32(dev, "realtek,stream-cpu", &cpu) &&
+		cpu < nr_cpu_ids && cpu_online(cpu))
+		worker = kthread_create_worker_on_cpu(cpu, 0, "rt5514-%s",
+			dev_name(dev));
+	else
+		worker = kthread_create_worker(0, "rt5514-%s", dev_name(dev));
+	if (IS_ERR(worker)) {
+		ret = PTR_ERR(worker);
+		dev_err(dev, "Failed to create stream worker: %d\n", ret);
+		return ret;
+	}
+
+	ret = devm_add_action_or_reset(dev, rt5514_spi_destroy_worker, worker);
+	if (ret)
+		return ret;
+
+	rt5514_dsp->worker = worker;
+
+	if (!device_property_read_u32(dev, "realtek,stream-fifo-priority",
+		&prio) && prio) {
+		param.sched_priority = min_t(u32, prio, MAX_RT_PRIO - 1);
+		ret = sched_setscheduler_nocheck(worker->task, SCHED_FIFO,
+			&param);
+		if (ret)
+			dev_warn(dev, "Failed to set stream priority: %d\n",
+				ret);
+	}
+
+	return 0;
+}
+
+/*
+ * Pick the burst chunk size from the limits of the SPI master controller.
+ * A burst write chunk carries a 5 byte header and a 1 byte trailer in the
+ * same transfer, and a burst read chunk a 9 byte header in the same message.
+ * Controllers without a limit get the largest chunk, and
+ * "realtek,spi-burst-len" can lower it for boards that need smaller ones.
+ */
+static void rt5514_spi_calc_buf_len(struct rt5514_dsp *rt5514_dsp)
+{
+	struct spi_device *spi = rt5514_dsp->spi;
+	size_t max_xfer = spi_max_transfer_size(spi);
+	size_t max_msg = spi_max_message_size(spi);
+	size_t len = RT5514_SPI_BUF_LEN_MAX;
+	u32 burst_len;
+
+	max_xfer = min(max_xfer, max_msg);
+	if (max_xfer != SIZE_MAX)
+		len = max_xfer > 6 ? max_xfer - 6 : 0;
+
+	if (!device_property_read_u32(&spi->dev, "realtek,spi-burst-len",
+		&burst_len) && burst_len)
+		len = max_xfer > 6 ? min_t(size_t, burst_len, max_xfer - 6) : 0;
+
+	len = round_down(min_t(size_t, len, RT5514_SPI_BUF_LEN_MAX), 8);
+	if (!len)
+		len = 8;
+
+	rt5514_dsp->buf_len = len;
+	rt5514_dsp->msg_chunks = clamp_t(size_t, max_msg / (len + 9), 1,
+		RT5514_SPI_MSG_CHUNKS);
+	/* A register read is a 5 byte command, 4 dummy and 4 data bytes */
+	rt5514_dsp->reg_chunks = clamp_t(size_t, max_msg / 13, 1,
+		RT5514_SPI_MSG_CHUNKS);
+
+	dev_dbg(&spi->dev, "burst chunk %zu bytes, %u chunks per message\n",
+		rt5514_dsp->buf_len, rt5514_dsp->msg_chunks);
+}
+
+static int rt5514_spi_regmap_read(void *context, unsigned int reg,
+	unsigned int *val)
+{
+	return rt5514_spi_read(context, reg, val);
+}
+
+static int rt5514_spi_regmap_write(void *context, unsigned int reg,
+	unsigned int val)
+{
+	return rt5514_spi_write(context, reg, val);
+}
+
+static const struct regmap_config rt5514_spi_regmap = {
+	.name = "spi",
+	.reg_bits = 32,
+	.val_bits = 32,
+	.reg_read = rt5514_spi_regmap_read,
+	.reg_write = rt5514_spi_regmap_write,
+
+	.cache_type = REGCACHE_NONE,
+};
+
+/**
+ * rt5514_spi_get_regmap - Get the regmap of the DSP registers over SPI.
+ * @rt5514_dsp: The DSP instance.
+ *
+ * Returns the regmap.
+ */
+struct regmap *rt5514_spi_get_regmap(struct rt5514_dsp *rt5514_dsp)
+{
+	return rt5514_dsp->regmap;
+}
+EXPORT_SYMBOL_GPL(rt5514_spi_get_regmap);
+
+static int rt5514_spi_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5514_dsp *rt5514_dsp = s->private;
+	struct rt5514_spi_stats stats;
+	unsigned int i, j;
+
+	spin_lock(&rt5514_dsp->stats_lock);
+	stats = rt5514_dsp->stats;
+	spin_unlock(&rt5514_dsp->stats_lock);
+
+	seq_printf(s, "messages: %llu\n", stats.messages);
+	seq_printf(s, "bytes_read: %llu\n", stats.bytes_read);
+	seq_printf(s, "bytes_written: %llu\n", stats.bytes_written);
+	seq_printf(s, "errors: %llu\n", stats.errors);
+	seq_printf(s, "retries: %llu\n", stats.retries);
+
+	seq_puts(s, "latency_us:");
+	for (j = 0; j < RT5514_SPI_LAT_BINS; j++)
+		seq_printf(s, " %u", j ? 1 << (j - 1) : 0);
+	seq_puts(s, "\n");
+
+	for (i = 0; i < RT5514_SPI_CLASS_NUM; i++) {
+		seq_printf(s, "%s:", rt5514_spi_class_name[i]);
+		for (j = 0; j < RT5514_SPI_LAT_BINS; j++)
+			seq_printf(s, " %u", stats.latency[i][j]);
+		seq_puts(s, "\n");
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rt5514_spi_stats);
+
+static ssize_t rt5514_spi_reset_write(struct file *file,
+	const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct rt5514_dsp *rt5514_dsp = file->private_data;
+
+	spin_lock(&rt5514_dsp->stats_lock);
+	memset(&rt5514_dsp->stats, 0, sizeof(rt5514_dsp->stats));
+	spin_unlock(&rt5514_dsp->stats_lock);
+
+	return count;
+}
+
+static const struct file_operations rt5514_spi_reset_fops = {
+	.open = simple_open,
+	.write = rt5514_spi_reset_write,
+	.llseek = default_llseek,
+};
+
+static void rt5514_spi_debugfs_init(struct rt5514_dsp *rt5514_dsp)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "rt5514-%s", dev_name(rt5514_dsp->dev));
+
+	rt5514_dsp->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("stats", 0444, rt5514_dsp->debugfs, rt5514_dsp,
+		&rt5514_spi_stats_fops);
+	debugfs_create_file("reset", 0200, rt5514_dsp->debugfs, rt5514_dsp,
+		&rt5514_spi_reset_fops);
+}
+
+/*
+ * The works use the codec only under rt5514_dsp_list_lock, so once it is
+ * cleared no new use starts. Works already queued are cancelled, and the
+ * copy works they may have queued are flushed, before the codec goes away.
+ */
+static void rt5514_spi_put_dsp(void *data)
+{
+	struct rt5514_dsp *rt5514_dsp = data;
+	unsigned int i;
+
+	mutex_lock(&rt5514_dsp_list_lock);
+	rt5514_dsp->codec = NULL;
+	mutex_unlock(&rt5514_dsp_list_lock);
+
+	cancel_delayed_work_sync(&rt5514_dsp->start_work);
+	for (i = 0; i < RT5514_STREAM_NUM; i++)
+		cancel_delayed_work_sync(&rt5514_dsp->stream[i].arm_work);
+	kthread_flush_worker(rt5514_dsp->worker);
+}
+
+/**
+ * rt5514_spi_get_dsp - Get the SPI companion of an RT5514 codec.
+ * @dev: The codec device.
+ * @rt5514: The codec private data.
+ *
+ * The SPI device is taken from the "realtek,spi-companion" phandle of the
+ * codec. The codec is unbound before its SPI companion goes away.
+ *
+ * Returns the DSP instance, NULL if the codec has no phandle and reaches
+ * the DSP over I2C only, or an ERR_PTR; -EPROBE_DEFER if the SPI device is
+ * not bound yet.
+ */
+struct rt5514_dsp *rt5514_spi_get_dsp(struct device *dev,
+	struct rt5514_priv *rt5514)
+{
+	struct device_node *np = of_parse_phandle(dev->of_node,
+		"realtek,spi-companion", 0);
+	struct rt5514_dsp *rt5514_dsp = NULL, *iter;
+	int ret = 0;
+
+	if (!np)
+		return NULL;
+
+	mutex_lock(&rt5514_dsp_list_lock);
+
+	list_for_each_entry(iter, &rt5514_dsp_list, list) {
+		if (iter->spi->dev.of_node == np) {
+			rt5514_dsp = iter;
+			break;
+		}
+	}
+
+	if (!rt5514_dsp) {
+		ret = -EPROBE_DEFER;
+	} else if (rt5514_dsp->codec) {
+		ret = -EBUSY;
+	} else if (!device_link_add(dev, rt5514_dsp->dev,
+		DL_FLAG_AUTOREMOVE_CONSUMER)) {
+		ret = -EINVAL;
+	} else {
+		rt5514_dsp->codec = rt5514;
+	}
+
+	mutex_unlock(&rt5514_dsp_list_lock);
+	of_node_put(np);
+
+	if (ret)
+		return ERR_PTR(ret);
+
+	ret = devm_add_action_or_reset(dev, rt5514_spi_put_dsp, rt5514_dsp);
+	if (ret)
+		return ERR_PTR(ret);
+
+	return rt5514_dsp;
+}
+EXPORT_SYMBOL_GPL(rt5514_spi_get_dsp);
+
+/*
+ * The fill watermark interface differs between firmware builds, so its
+ * mailbox address, the feature_id bits the firmware announces it with and
+ * the IRQ_FLAG bit it raises come from the firmware spec through
+ * "realtek,spi-watermark" = <mailbox feature irq-flag>.
+ */
+static void rt5514_spi_parse_wm(struct rt5514_dsp *rt5514_dsp)
+{
+	u32 wm[3];
+
+	if (device_property_read_u32_array(rt5514_dsp->dev,
+		"realtek,spi-watermark", wm, ARRAY_SIZE(wm)))
+		return;
+
+	if (!wm[0] || !wm[1] || !wm[2]) {
+		dev_warn(rt5514_dsp->dev, "Invalid realtek,spi-watermark\n");
+		return;
+	}
+
+	rt5514_dsp->wm_mailbox = wm[0];
+	rt5514_dsp->wm_feature = wm[1];
+	rt5514_dsp->wm_irq = wm[2];
+	rt5514_dsp->wm_mode = true;
+}
+
 static int rt5514_spi_probe(struct spi_device *spi)
 {
+	struct rt5514_dsp *rt5514_dsp;
 	int ret;
 
-	rt5514_spi = spi;
-	mutex_init(&spi_lock);
+	rt5514_dsp = devm_kzalloc(&spi->dev, sizeof(*rt5514_dsp), GFP_KERNEL);
+	if (!rt5514_dsp)
+		return -ENOMEM;
+
+	rt5514_dsp->spi = spi;
+	rt5514_dsp->dev = &spi->dev;
+	mutex_init(&rt5514_dsp->spi_lock);
+	mutex_init(&rt5514_dsp->dma_lock);
+	mutex_init(&rt5514_dsp->ring_lock);
+	init_waitqueue_head(&rt5514_dsp->stream_wq);
+	spin_lock_init(&rt5514_dsp->stats_lock);
+	spi_set_drvdata(spi, rt5514_dsp);
+
+	rt5514_spi_calc_buf_len(rt5514_dsp);
+
+	device_property_read_u32(&spi->dev, "realtek,spi-sram-speed-hz",
+		&rt5514_dsp->sram_speed_hz);
+	device_property_read_u32(&spi->dev, "realtek,spi-reg-speed-hz",
+		&rt5514_dsp->reg_speed_hz);
+	rt5514_dsp->bus_lock_mode = device_property_read_bool(&spi->dev,
+		"realtek,spi-bus-lock");
+	rt5514_dsp->long_burst = device_property_read_bool(&spi->dev,
+		"realtek,spi-long-burst");
+	rt5514_spi_parse_wm(rt5514_dsp);
+	rt5514_dsp->overrun_xrun = device_property_read_bool(&spi->dev,
+		"realtek,spi-overrun-xrun");
+
+	ret = rt5514_spi_alloc_bufs(rt5514_dsp);
+	if (ret)
+		return ret;
+
+	ret = rt5514_spi_create_worker(rt5514_dsp);
+	if (ret)
+		return ret;
+
+	rt5514_spi_init_streams(rt5514_dsp);
+
+	rt5514_dsp->regmap = devm_regmap_init(&spi->dev, NULL, rt5514_dsp,
+		&rt5514_spi_regmap);
+	if (IS_ERR(rt5514_dsp->regmap)) {
+		ret = PTR_ERR(rt5514_dsp->regmap);
+		dev_err(&spi->dev, "Failed to allocate register map: %d\n",
+			ret);
+		return ret;
+	}
 
 	ret = devm_snd_soc_register_component(&spi->dev,
 					      &rt5514_spi_component,
@@ -1235,6 +2773,25 @@ static int rt5514_spi_probe(struct spi_device *spi)
 
 	device_init_wakeup(&spi->dev, true);
 
+	rt5514_spi_debugfs_init(rt5514_dsp);
+
+	mutex_lock(&rt5514_dsp_list_lock);
+	list_add_tail(&rt5514_dsp->list, &rt5514_dsp_list);
+	mutex_unlock(&rt5514_dsp_list_lock);
+
+	return 0;
+}
+
+static int rt5514_spi_remove(struct spi_device *spi)
+{
+	struct rt5514_dsp *rt5514_dsp = spi_get_drvdata(spi);
+
+	mutex_lock(&rt5514_dsp_list_lock);
+	list_del(&rt5514_dsp->list);
+	mutex_unlock(&rt5514_dsp_list_lock);
+
+	debugfs_remove_recursive(rt5514_dsp->debugfs);
+
 	return 0;
 }
 
@@ -1275,6 +2832,7 @@ static struct spi_driver rt5514_spi_driver = {
 		.of_match_table = of_match_ptr(rt5514_of_match),
 	},
 	.probe = rt5514_spi_probe,
+	.remove = rt5514_spi_remove,
 };
 module_spi_driver(rt5514_spi_driver);
 
@@ -13,12 +13,23 @@
 #define __RT5514_SPI_H__
 
 /**
- * RT5514_SPI_BUF_LEN is the buffer size of SPI master controller.
+ * RT5514_SPI_BUF_LEN_MAX is the largest burst chunk size, used when the SPI
+ * master controller does not report a transfer size limit. The chunk size
+ * actually used is chosen at probe from the controller limits.
  * The value should be mulitple of 8.
 */
-#define RT5514_SPI_BUF_LEN		240
+#define RT5514_SPI_BUF_LEN_MAX		4096
+/**
+ * RT5514_SPI_MSG_CHUNKS is the maximum number of chunks chained into one
+ * spi_message by a burst read.
+*/
+#define RT5514_SPI_MSG_CHUNKS		32
 #define RT5514_SPI_RETRY_CNT		100
-#define RT5514_DSP_STREAM_NUM		(RT5514_DSP_MODEL_NUM + 1)
+/**
+ * RT5514_SPI_XFER_RETRY is the number of times a failed bulk transfer chunk
+ * is resent before the transfer gives up.
+*/
+#define RT5514_SPI_XFER_RETRY		3
 
 #define RT5514_BUFFER_VOICE_BASE	0x18002fb4
 #define RT5514_BUFFER_VOICE_LIMIT	0x18002fb8
@@ -38,6 +49,9 @@
 #define RT5514_FW_CTRL1			0x1800102c
 #define RT5514_FW_STATUS0		0x18001030
 
+/* Offset of the RT5514_DSP_FW_VER header in the firmware image */
+#define RT5514_FW_VER_OFFSET		0x100
+
 /* SPI Command */
 enum {
 	RT5514_SPI_CMD_16_READ = 0,
@@ -56,6 +70,15 @@ enum {
 	RT5514_DSP_STREAM_MUSDET_BRK,
 };
 
+/* Who a transfer is for, for the latency statistics */
+enum rt5514_spi_class {
+	RT5514_SPI_CLASS_STREAM,
+	RT5514_SPI_CLASS_FW,
+	RT5514_SPI_CLASS_CTRL,
+	RT5514_SPI_CLASS_DBG,
+	RT5514_SPI_CLASS_NUM,
+};
+
 #define RT5514_DBG_BUF_SIZE 0x100
 #define RT5514_DBG_BUF_CNT  0x1f // (DBG_BUF_SIZE-2*4)/8
 
@@ -71,10 +94,21 @@ typedef struct _dbgBuf_Mem {
 	unsigned int idx;
 } RT5514_DBGBUF_MEM;
 
-int rt5514_spi_burst_read(unsigned int addr, u8 *rxbuf, size_t len);
-int rt5514_spi_burst_write(u32 addr, const u8 *txbuf, size_t len);
-int rt5514_spi_read(unsigned int addr, unsigned int *val);
-int rt5514_spi_write(unsigned int addr, unsigned int val);
-bool rt5514_dump_dbg_info(void);
+int rt5514_spi_burst_read(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	u8 *rxbuf, size_t len, enum rt5514_spi_class class, size_t *done);
+int rt5514_spi_burst_write(struct rt5514_dsp *rt5514_dsp, u32 addr,
+	const u8 *txbuf, size_t len, enum rt5514_spi_class class, size_t *done);
+int rt5514_spi_fill(struct rt5514_dsp *rt5514_dsp, u32 addr, u32 pattern,
+	size_t len, enum rt5514_spi_class class);
+int rt5514_spi_read(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	unsigned int *val);
+int rt5514_spi_read_multi(struct rt5514_dsp *rt5514_dsp,
+	const unsigned int *addrs, unsigned int *vals, unsigned int num);
+int rt5514_spi_write(struct rt5514_dsp *rt5514_dsp, unsigned int addr,
+	unsigned int val);
+struct regmap *rt5514_spi_get_regmap(struct rt5514_dsp *rt5514_dsp);
+struct rt5514_dsp *rt5514_spi_get_dsp(struct device *dev,
+	struct rt5514_priv *rt5514);
+bool rt5514_dump_dbg_info(struct rt5514_dsp *rt5514_dsp);
 
 #endif /* __RT5514_SPI_H__ */
@@ -36,10 +36,6 @@
 #include "rt5514-spi.h"
 #endif
 
-struct regmap *rt5514_g_i2c_regmap;
-EXPORT_SYMBOL_GPL(rt5514_g_i2c_regmap);
-struct rt5514_priv *g_rt5514;
-
 static const struct reg_sequence rt5514_i2c_patch[] = {
 	{0xfafafafa, 0x00000001},
 	{0x18002000, 0x000010ec},
@@ -122,17 +118,33 @@ static const struct reg_default rt5514_reg[] = {
 	{RT5514_VENDOR_ID2,		0x10ec5514},
 };
 
-int rt5514_set_gpio(int gpio, bool output)
+/*
+ * The DSP mailbox and status registers are reached over SPI when the codec
+ * has an SPI companion, which is much faster than I2C, and over I2C
+ * otherwise.
+ */
+static struct regmap *rt5514_dsp_regmap(struct rt5514_priv *rt5514)
+{
+#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
+	if (rt5514->dsp)
+		return rt5514_spi_get_regmap(rt5514->dsp);
+#endif
+	return rt5514->i2c_regmap;
+}
+
+int rt5514_set_gpio(struct device *dev, int gpio, bool output)
 {
+	struct rt5514_priv *rt5514 = dev_get_drvdata(dev);
+
 	switch (gpio) {
 	case 5:
-		regmap_write(rt5514_g_i2c_regmap, 0x18002070, 0x000c0140);
-		regmap_write(rt5514_g_i2c_regmap, 0x18002074,
+		regmap_write(rt5514->i2c_regmap, 0x18002070, 0x000c0140);
+		regmap_write(rt5514->i2c_regmap, 0x18002074,
 			output << 21 | 1 << 22);
-		regmap_write(rt5514_g_i2c_regmap, 0x18002070, 0x00000140);
+		regmap_write(rt5514->i2c_regmap, 0x18002070, 0x00000140);
 		break;
 	case 50:
-		regmap_write(rt5514_g_i2c_regmap, 0x18001014, output ? 8 : 4);
+		regmap_write(rt5514->i2c_regmap, 0x18001014, output ? 8 : 4);
 		break;
 
 	default:
@@ -347,11 +359,14 @@ static int rt5514_dsp_frame_flag_get(struct snd_kcontrol *kcontrol,
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
 	struct rt5514_priv *rt5514 = snd_soc_component_get_drvdata(component);
-	u8 buf[8];
 	unsigned int value_spi, value_i2c;
 
-	rt5514_spi_burst_read(RT5514_BUFFER_MUSIC_WP, (u8 *)&buf, sizeof(buf));
-	value_spi = buf[0] | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
+	if (!rt5514->dsp) {
+		ucontrol->value.integer.value[0] = 0;
+		return 0;
+	}
+
+	rt5514_spi_read(rt5514->dsp, RT5514_BUFFER_MUSIC_WP, &value_spi);
 	if ((value_spi & 0xffe00000) != 0x4fe00000) {
 		ucontrol->value.integer.value[0] = 0;
 		return 0;
@@ -451,14 +466,20 @@ static int rt5514_fw_validate_raw(struct rt5514_priv *rt5514, int index, int add
 
 	fw = rt5514_request_firmware(rt5514, index);
 	if (fw) {
-		buf = kmalloc(((fw->size/8)+1)*8, GFP_KERNEL);
+		buf = kmalloc(fw->size, GFP_KERNEL);
+		if (!buf)
+			return -ENOMEM;
 
+		ret = -ENODEV;
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-		rt5514_spi_burst_read(addr, buf, ((fw->size/8)+1)*8);
-#else
-		dev_err(component->dev, "There is no SPI driver for reading the firmware\n");
+		if (rt5514->dsp)
+			ret = rt5514_spi_burst_read(rt5514->dsp, addr, buf,
+				fw->size, RT5514_SPI_CLASS_FW, NULL);
+		else
 #endif
-		ret = rt5514_memcmp(rt5514, buf, fw->data, fw->size);
+			dev_err(component->dev, "There is no SPI driver for reading the firmware\n");
+		if (!ret)
+			ret = rt5514_memcmp(rt5514, buf, fw->data, fw->size);
 
 		kfree(buf);
 		if (ret) {
@@ -481,14 +502,21 @@ static int rt5514_fw_validate(struct rt5514_priv *rt5514, int index, int addr)
 	} else {
 		if (rt5514->model_buf[index-2] && rt5514->model_len[index-2] &&
 			addr && !rt5514->load_default_sound_model) {
-			buf = kmalloc(((rt5514->model_len[index-2]/8)+1)*8, GFP_KERNEL);
+			buf = kmalloc(rt5514->model_len[index-2], GFP_KERNEL);
+			if (!buf)
+				return -ENOMEM;
 
+			ret = -ENODEV;
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-			rt5514_spi_burst_read(addr, buf, ((rt5514->model_len[index-2]/8)+1)*8);
-#else
-			dev_err(component->dev, "There is no SPI driver for reading the firmware\n");
+			if (rt5514->dsp)
+				ret = rt5514_spi_burst_read(rt5514->dsp, addr,
+					buf, rt5514->model_len[index-2],
+					RT5514_SPI_CLASS_FW, NULL);
+			else
 #endif
-			ret = rt5514_memcmp(rt5514, buf, rt5514->model_buf[index-2], rt5514->model_len[index-2]);
+				dev_err(component->dev, "There is no SPI driver for reading the firmware\n");
+			if (!ret)
+				ret = rt5514_memcmp(rt5514, buf, rt5514->model_buf[index-2], rt5514->model_len[index-2]);
 
 			kfree(buf);
 			if (ret) {
@@ -517,7 +545,7 @@ static int rt5514_dsp_status_check(struct rt5514_priv *rt5514)
 	}
 
 	for (i = 0; i < 10; i++) {
-		regmap_read(rt5514->i2c_regmap, 0x18001014, &val);
+		regmap_read(rt5514_dsp_regmap(rt5514), 0x18001014, &val);
 		if (val == 0)
 			break;
 		else
@@ -543,11 +571,48 @@ reset:
 	return val;
 }
 
+#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
+#define RT5514_DSP_LOAD_RETRY 3
+
+/*
+ * Load an image into DSP memory. The SPI driver already resends a failed
+ * chunk, so if the write still fails, back off and pick it up again from
+ * the first byte that did not land instead of starting over.
+ */
+static int rt5514_dsp_load(struct rt5514_priv *rt5514, u32 addr,
+	const u8 *data, size_t len)
+{
+	struct snd_soc_component *component = rt5514->component;
+	size_t done, offset = 0;
+	int ret, retry = 0;
+
+	if (!rt5514->dsp) {
+		dev_err(component->dev, "No SPI companion for loading firmware\n");
+		return -ENODEV;
+	}
+
+	for (;;) {
+		ret = rt5514_spi_burst_write(rt5514->dsp, addr + offset,
+			data + offset, len - offset, RT5514_SPI_CLASS_FW, &done);
+		offset += done;
+		if (!ret || retry++ == RT5514_DSP_LOAD_RETRY)
+			break;
+
+		dev_warn(component->dev, "Load stopped at %#zx/%#zx (%d), resuming\n",
+			offset, len, ret);
+		usleep_range(1000, 2000);
+	}
+
+	return ret;
+}
+#endif
+
 static int rt5514_dsp_enable(struct rt5514_priv *rt5514, bool is_adc, bool is_watchdog)
 {
 	struct snd_soc_component *component = rt5514->component;
 	const struct firmware *fw = NULL;
 	unsigned int val, i;
+	int __maybe_unused ret;
 
 	if (is_watchdog)
 		goto watchdog;
@@ -555,18 +620,18 @@ static int rt5514_dsp_enable(struct rt5514_priv *rt5514, bool is_adc, bool is_wa
 	if (is_adc) {
 		if (rt5514->dsp_enabled) {
 			if (rt5514->dsp_adc_enabled) {
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_WOV_SENSOR);
 			} else {
 				if (rt5514->dsp_model)
-					regmap_write(rt5514->i2c_regmap,
+					regmap_write(rt5514_dsp_regmap(rt5514),
 						RT5514_DSP_FUNC, RT5514_DSP_FUNC_WOV);
 				else
-					regmap_write(rt5514->i2c_regmap,
+					regmap_write(rt5514_dsp_regmap(rt5514),
 						RT5514_DSP_FUNC, RT5514_DSP_FUNC_SUSPEND);
 			}
 
-			regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+			regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 
 			return 0;
 		}
@@ -581,7 +646,7 @@ watchdog:
 		regmap_multi_reg_write(rt5514->i2c_regmap,
 			rt5514_i2c_patch, ARRAY_SIZE(rt5514_i2c_patch));
 		rt5514_enable_dsp_prepare(rt5514);
-		regmap_write(rt5514->i2c_regmap,
+		regmap_write(rt5514_dsp_regmap(rt5514),
 			RT5514_DSP_WOV_TYPE, rt5514->dsp_model & 0xff);
 
 		for (i = 0; i < 2; i++) {
@@ -593,8 +658,13 @@ watchdog:
 						sizeof(unsigned int) * RT5514_DSP_MODEL_NUM);
 
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-				rt5514_spi_burst_write(rt5514->fw_addr[i], fw->data,
-					fw->size);
+				ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[i],
+					fw->data, fw->size);
+				if (ret) {
+					dev_err(component->dev,
+						"FW load failed %d\n", ret);
+					return ret;
+				}
 #else
 				dev_err(component->dev, "There is no SPI driver for"
 					" loading the firmware\n");
@@ -616,8 +686,13 @@ watchdog:
 			fw = rt5514_request_firmware(rt5514, 2);
 			if (fw) {
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-				rt5514_spi_burst_write(rt5514->fw_addr[2],
+				ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[2],
 					fw->data, fw->size);
+				if (ret) {
+					dev_err(component->dev,
+						"FW load failed %d\n", ret);
+					return ret;
+				}
 #else
 				dev_err(component->dev,
 					"No SPI driver for loading firmware\n");
@@ -628,10 +703,9 @@ watchdog:
 				if (rt5514->dsp_enabled && (rt5514->dsp_model & (0x1 << i))
 					&& rt5514->model_buf[i] && rt5514->model_len[i]) {
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-					int ret;
 					printk(">>>>> TRACE [%s]->(%d) %d = %08x <<<<<\n", __FUNCTION__, __LINE__, i, rt5514->fw_addr[i+2]);
 
-					ret = rt5514_spi_burst_write(rt5514->fw_addr[i+2],
+					ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[i+2],
 						rt5514->model_buf[i],
 						rt5514->model_len[i]);
 					if (ret) {
@@ -676,9 +750,14 @@ watchdog:
 			printk(">>>>> TRACE [%s]->(%d) %d = %08x <<<<<\n", __FUNCTION__, __LINE__, i, rt5514->fw_addr[i+2]);
 
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-		rt5514_spi_burst_write(rt5514->fw_addr[0] + 0x138,
+		ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[0] + 0x138,
 			(const u8 *)&rt5514->fw_addr[2],
 			sizeof(unsigned int) * RT5514_DSP_MODEL_NUM);
+		if (ret) {
+			dev_err(component->dev,
+				"Model table load failed %d\n", ret);
+			return ret;
+		}
 #else
 		dev_err(component->dev,
 			"No SPI driver for loading firmware\n");
@@ -700,12 +779,12 @@ watchdog:
 			if (rt5514->dsp_adc_enabled) {
 				switch (rt5514->pcm_rate) {
 				case SNDRV_PCM_RATE_48000:
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_WOV_I2S_SENSOR);
 					break;
 				
 				case SNDRV_PCM_RATE_96000:
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_WOV_I2S_96k_SENSOR);
 					break;
 				
@@ -716,12 +795,12 @@ watchdog:
 				if (rt5514->dsp_model) {
 					switch (rt5514->pcm_rate) {
 					case SNDRV_PCM_RATE_48000:
-						regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+						regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 							RT5514_DSP_FUNC_WOV_I2S);
 						break;
 					
 					case SNDRV_PCM_RATE_96000:
-						regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+						regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 							RT5514_DSP_FUNC_WOV_I2S_96k);
 						break;
 					
@@ -732,12 +811,12 @@ watchdog:
 				} else {
 					switch (rt5514->pcm_rate) {
 					case SNDRV_PCM_RATE_48000:
-						regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+						regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 							RT5514_DSP_FUNC_I2S);
 						break;
 					
 					case SNDRV_PCM_RATE_96000:
-						regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+						regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 							RT5514_DSP_FUNC_I2S_96k);
 						break;
 					
@@ -760,19 +839,19 @@ watchdog:
 			regmap_write(rt5514->regmap, RT5514_DOWNFILTER2_CTRL1, val);
 		} else {
 			if (rt5514->dsp_adc_enabled) {
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_WOV_SENSOR);
 			} else {
 				if (rt5514->dsp_model)
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_WOV);
 				else
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_SUSPEND);
 			}
 		}
 
-		regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+		regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 	} else {
 		if (rt5514->gpiod_reset) {
 			gpiod_set_value(rt5514->gpiod_reset, 0);
@@ -789,27 +868,61 @@ watchdog:
 	return 0;
 }
 
-void rt5514_watchdog_handler(void)
+int rt5514_watchdog_handler(struct rt5514_priv *rt5514)
 {
-	if (g_rt5514->gpiod_reset) {
-		gpiod_set_value(g_rt5514->gpiod_reset, 0);
+	int ret;
+
+	if (rt5514->gpiod_reset) {
+		gpiod_set_value(rt5514->gpiod_reset, 0);
 		usleep_range(1000, 2000);
-		gpiod_set_value(g_rt5514->gpiod_reset, 1);
+		gpiod_set_value(rt5514->gpiod_reset, 1);
 	} else {
-		regmap_multi_reg_write(rt5514_g_i2c_regmap,
+		regmap_multi_reg_write(rt5514->i2c_regmap,
 			rt5514_i2c_patch, ARRAY_SIZE(rt5514_i2c_patch));
 	}
 
-	rt5514_dsp_enable(g_rt5514, false, true);
+	ret = rt5514_dsp_enable(rt5514, false, true);
+	if (ret)
+		dev_err(rt5514->component->dev, "DSP reload failed %d\n", ret);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(rt5514_watchdog_handler);
 
+/*
+ * Enable the DSP, reload it if it does not run, and fall back to the
+ * default sound model if it still does not.
+ */
+static int rt5514_dsp_start(struct rt5514_priv *rt5514, bool is_adc)
+{
+	int ret;
+
+	ret = rt5514_dsp_enable(rt5514, is_adc, false);
+	if (ret)
+		return ret;
+
+	if (rt5514_dsp_status_check(rt5514)) {
+		ret = rt5514_dsp_enable(rt5514, false, true);
+		if (ret)
+			return ret;
+	}
+
+	if (rt5514_dsp_status_check(rt5514)) {
+		rt5514->load_default_sound_model = true;
+		ret = rt5514_dsp_enable(rt5514, false, true);
+		rt5514->load_default_sound_model = false;
+	}
+
+	return ret;
+}
+
 static int rt5514_dsp_put(struct snd_kcontrol *kcontrol,
 		struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
 	struct rt5514_priv *rt5514 = snd_soc_component_get_drvdata(component);
 	RT5514_DSP_MEM dsp_mem;
+	int ret = 0;
 	printk(">>>>> TRACE [%s]->(%d) %ld <<<<<\n", __FUNCTION__, __LINE__, ucontrol->value.integer.value[0]);
 
 	if (ucontrol->value.integer.value[0] == rt5514->dsp_enabled)
@@ -819,22 +932,15 @@ static int rt5514_dsp_put(struct snd_kcontrol *kcontrol,
 	rt5514->dsp_enabled = ucontrol->value.integer.value[0];
 
 	if (!rt5514->is_streaming) {
-		rt5514_dsp_enable(rt5514, false, false);
-
-		if (rt5514_dsp_status_check(rt5514))
-			rt5514_dsp_enable(rt5514, false, true);
-
-		if (rt5514_dsp_status_check(rt5514)) {
-			rt5514->load_default_sound_model = true;
-			rt5514_dsp_enable(rt5514, false, true);
-			rt5514->load_default_sound_model = false;
-		}
+		ret = rt5514_dsp_start(rt5514, false);
+		if (ret)
+			dev_err(component->dev, "DSP enable failed %d\n", ret);
 	} else {
 		dev_warn(component->dev, "Unsupport : %d %d\n",
 			rt5514->dsp_enabled, rt5514->dsp_adc_enabled);
 	}
 
-	return 0;
+	return ret;
 }
 
 static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
@@ -845,6 +951,7 @@ static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
 	const struct firmware *fw = NULL;
 	int dsp_model_last = rt5514->dsp_model;
 	unsigned int val, i, changed_model;
+	int __maybe_unused ret;
 	printk(">>>>> TRACE [%s]->(%d) %s %ld <<<<<\n", __FUNCTION__, __LINE__, kcontrol->id.name, ucontrol->value.integer.value[0]);
 
 	if (!strcmp("DSP Voice Wake Up", kcontrol->id.name)) {
@@ -881,13 +988,13 @@ static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
 	if (rt5514->dsp_enabled) {
 		if (!rt5514->dsp_adc_enabled && !rt5514->is_streaming) {
 			if (rt5514->dsp_model && !dsp_model_last) {
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_WOV);
-				regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+				regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 			} else if (!rt5514->dsp_model) {
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_SUSPEND);
-				regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+				regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 
 				return 0;
 			}
@@ -905,18 +1012,23 @@ static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
 			printk(">>>>> TRACE [%s]->(%d) %d = %08x <<<<<\n", __FUNCTION__, __LINE__, i, rt5514->fw_addr[i+2]);
 
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-		rt5514_spi_burst_write(rt5514->fw_addr[0] + 0x138,
+		ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[0] + 0x138,
 			(const u8 *)&rt5514->fw_addr[2],
 			sizeof(unsigned int) * RT5514_DSP_MODEL_NUM);
+		if (ret) {
+			dev_err(component->dev,
+				"Model table load failed %d\n", ret);
+			return ret;
+		}
 #else
 		dev_err(component->dev,
 			"No SPI driver for loading firmware\n");
 #endif
 
-		regmap_write(rt5514->i2c_regmap, RT5514_FW_CTRL1, 1);
-		regmap_read(rt5514->i2c_regmap, RT5514_FW_STATUS0, &val);
+		regmap_write(rt5514_dsp_regmap(rt5514), RT5514_FW_CTRL1, 1);
+		regmap_read(rt5514_dsp_regmap(rt5514), RT5514_FW_STATUS0, &val);
 		for (i = 0; i < 100 && (!(val & 0x8000)); i++) {
-			regmap_read(rt5514->i2c_regmap, RT5514_FW_STATUS0, &val);
+			regmap_read(rt5514_dsp_regmap(rt5514), RT5514_FW_STATUS0, &val);
 			msleep(10);
 		}
 
@@ -938,10 +1050,15 @@ static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
 
 			for (i = 0; i < RT5514_DSP_MODEL_NUM; i++)
 				printk(">>>>> TRACE [%s]->(%d) %d = %08x <<<<<\n", __FUNCTION__, __LINE__, i, rt5514->fw_addr[i+2]);
-#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)			
-			rt5514_spi_burst_write(rt5514->fw_addr[0] + 0x138,
+#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
+			ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[0] + 0x138,
 				(const u8 *)&rt5514->fw_addr[2],
 				sizeof(unsigned int) * RT5514_DSP_MODEL_NUM);
+			if (ret) {
+				dev_err(component->dev,
+					"Model table load failed %d\n", ret);
+				return ret;
+			}
 #else
 			dev_err(component->dev,
 				"No SPI driver for loading firmware\n");
@@ -950,12 +1067,10 @@ static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
 			for (i = 0; i < RT5514_DSP_MODEL_NUM; i++) {
 				if ((rt5514->dsp_model & (0x1 << i))
 					&& rt5514->model_buf[i] && rt5514->model_len[i]) {
-					int ret;
-
 					if (i >= changed_model) {
 						printk(">>>>> TRACE [%s]->(%d) %d = %08x <<<<<\n", __FUNCTION__, __LINE__, i, rt5514->fw_addr[i+2]);
 #if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
-						ret = rt5514_spi_burst_write(rt5514->fw_addr[i+2],
+						ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[i+2],
 							rt5514->model_buf[i],
 							rt5514->model_len[i]);
 
@@ -984,23 +1099,33 @@ static int rt5514_dsp_model_put(struct snd_kcontrol *kcontrol,
 			for (i = 0; i < RT5514_DSP_MODEL_NUM; i++)
 				printk(">>>>> TRACE [%s]->(%d) %d = %08x <<<<<\n", __FUNCTION__, __LINE__, i, rt5514->fw_addr[i+2]);
 
-			rt5514_spi_burst_write(rt5514->fw_addr[0] + 0x138,
+#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
+			ret = rt5514_dsp_load(rt5514, rt5514->fw_addr[0] + 0x138,
 				(const u8 *)&rt5514->fw_addr[2],
 				sizeof(unsigned int) * RT5514_DSP_MODEL_NUM);
+			if (ret) {
+				dev_err(component->dev,
+					"Model table load failed %d\n", ret);
+				return ret;
+			}
+#else
+			dev_err(component->dev,
+				"No SPI driver for loading firmware\n");
+#endif
 		}
 
-		regmap_write(rt5514->i2c_regmap, RT5514_FW_CTRL1, 0);
+		regmap_write(rt5514_dsp_regmap(rt5514), RT5514_FW_CTRL1, 0);
 		for (i = 0; i < 100 &&  (val & 0x8000); i++) {
-			regmap_read(rt5514->i2c_regmap, RT5514_FW_STATUS0, &val);
+			regmap_read(rt5514_dsp_regmap(rt5514), RT5514_FW_STATUS0, &val);
 			msleep(10);
 
 		}
 	}
 
-	regmap_write(rt5514->i2c_regmap,
+	regmap_write(rt5514_dsp_regmap(rt5514),
 		RT5514_DSP_WOV_TYPE, rt5514->dsp_model & 0xff);
 
-	regmap_read(rt5514->i2c_regmap, RT5514_DSP_WOV_TYPE, &val);
+	regmap_read(rt5514_dsp_regmap(rt5514), RT5514_DSP_WOV_TYPE, &val);
 	printk(">>>>> TRACE [%s]->(%d) IRQ Mask = %08x <<<<<\n", __FUNCTION__, __LINE__, val);
 
 	return 0;
@@ -1012,6 +1137,7 @@ static int rt5514_dsp_adc_put(struct snd_kcontrol *kcontrol,
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
 	struct rt5514_priv *rt5514 = snd_soc_component_get_drvdata(component);
+	int ret = 0;
 	printk(">>>>> TRACE [%s]->(%d) %ld <<<<<\n", __FUNCTION__, __LINE__, ucontrol->value.integer.value[0]);
 
 	if (ucontrol->value.integer.value[0] == rt5514->dsp_adc_enabled)
@@ -1020,16 +1146,9 @@ static int rt5514_dsp_adc_put(struct snd_kcontrol *kcontrol,
 
 	if (!rt5514->is_streaming) {
 		rt5514->dsp_adc_enabled = ucontrol->value.integer.value[0];
-		rt5514_dsp_enable(rt5514, true, false);
-
-		if (rt5514_dsp_status_check(rt5514))
-			rt5514_dsp_enable(rt5514, false, true);
-
-		if (rt5514_dsp_status_check(rt5514)) {
-			rt5514->load_default_sound_model = true;
-			rt5514_dsp_enable(rt5514, false, true);
-			rt5514->load_default_sound_model = false;
-		}
+		ret = rt5514_dsp_start(rt5514, true);
+		if (ret)
+			dev_err(component->dev, "DSP enable failed %d\n", ret);
 	} else {
 		rt5514->dsp_adc_enabled = ucontrol->value.integer.value[0];
 
@@ -1037,7 +1156,7 @@ static int rt5514_dsp_adc_put(struct snd_kcontrol *kcontrol,
 			rt5514->dsp_enabled, rt5514->dsp_adc_enabled);
 	}
 
-	return 0;
+	return ret;
 }
 
 static int rt5514_dsp_adc_get(struct snd_kcontrol *kcontrol,
@@ -1060,9 +1179,9 @@ static int rt5514_dsp_func_put(struct snd_kcontrol *kcontrol,
 	printk(">>>>> TRACE [%s]->(%d) %ld <<<<<\n", __FUNCTION__, __LINE__, ucontrol->value.integer.value[0]);
 
 	if (ucontrol->value.integer.value[0] >= 10) {
-		regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+		regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 			ucontrol->value.integer.value[0] - 10);
-		regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+		regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 	}
 
 	return 0;
@@ -1071,8 +1190,11 @@ static int rt5514_dsp_func_put(struct snd_kcontrol *kcontrol,
 static int rt5514_dsp_func_get(struct snd_kcontrol *kcontrol,
 		struct snd_ctl_elem_value *ucontrol)
 {
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5514_priv *rt5514 = snd_soc_component_get_drvdata(component);
 
-	rt5514_dump_dbg_info();
+	if (rt5514->dsp)
+		rt5514_dump_dbg_info(rt5514->dsp);
 	printk(">>>>> TRACE [%s]->(%d) %ld <<<<<\n", __FUNCTION__, __LINE__, ucontrol->value.integer.value[0]);
 
 	return 0;
@@ -1094,6 +1216,7 @@ static int rt5514_hw_reset_set(struct snd_kcontrol *kcontrol,
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
 	struct rt5514_priv *rt5514 = snd_soc_component_get_drvdata(component);
+	int ret = 0;
 
 	printk(">>>>> TRACE [%s]->(%d) %ld <<<<<\n", __FUNCTION__, __LINE__, ucontrol->value.integer.value[0]);
 
@@ -1101,11 +1224,13 @@ static int rt5514_hw_reset_set(struct snd_kcontrol *kcontrol,
 		gpiod_set_value(rt5514->gpiod_reset, 0);
 		usleep_range(1000, 2000);
 		gpiod_set_value(rt5514->gpiod_reset, 1);
-		rt5514_dsp_enable(rt5514, false, true);
+		ret = rt5514_dsp_enable(rt5514, false, true);
+		if (ret)
+			dev_err(component->dev, "DSP enable failed %d\n", ret);
 	}
 	printk(">>>>> TRACE [%s]->(%d) <<<<<\n", __FUNCTION__, __LINE__);
 
-	return 0;
+	return ret;
 }
 
 static int rt5514_hw_reset_get(struct snd_kcontrol *kcontrol,
@@ -1155,6 +1280,37 @@ done:
 	return ret;
 }
 
+/* Ambient payload address, size and status */
+static const unsigned int rt5514_payload_regs[] = {
+	0x18002fd4, 0x18002fd8, 0x18002fdc,
+};
+
+/*
+ * Read the ambient payload registers in one SPI message when the codec has
+ * an SPI companion, and one by one over I2C otherwise.
+ */
+static int rt5514_payload_regs_read(struct rt5514_priv *rt5514,
+	unsigned int *vals)
+{
+	unsigned int i;
+	int ret;
+
+#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
+	if (rt5514->dsp)
+		return rt5514_spi_read_multi(rt5514->dsp, rt5514_payload_regs,
+			vals, ARRAY_SIZE(rt5514_payload_regs));
+#endif
+
+	for (i = 0; i < ARRAY_SIZE(rt5514_payload_regs); i++) {
+		ret = regmap_read(rt5514->i2c_regmap, rt5514_payload_regs[i],
+			&vals[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 static int rt5514_ambient_payload_put(struct snd_kcontrol *kcontrol,
 		const unsigned int __user *bytes, unsigned int size)
 {
@@ -1163,20 +1319,26 @@ static int rt5514_ambient_payload_put(struct snd_kcontrol *kcontrol,
 	int ret = 0;
 	char payload[AMBIENT_COMMON_MAX_PAYLOAD_BUFFER_SIZE];
 	unsigned int payload_addr;
+	unsigned int vals[ARRAY_SIZE(rt5514_payload_regs)];
 
 	if (copy_from_user(payload, bytes, size))
 		return -EFAULT;
 
 	/* AmbientHotwordType */
 	regmap_write(rt5514->i2c_regmap, 0x18002fd0, payload[0]);
-	regmap_write(rt5514->i2c_regmap, 0x18001014, 2);
-	regmap_read(rt5514->i2c_regmap, 0x18002fd4, &payload_addr);
-	regmap_read(rt5514->i2c_regmap, 0x18002fd8, &rt5514->payload.size);
-	regmap_read(rt5514->i2c_regmap, 0x18002fdc, &rt5514->payload.status);
+	regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 2);
+	ret = rt5514_payload_regs_read(rt5514, vals);
+	if (ret)
+		return ret;
 
-	if ((payload_addr & 0xffe00000) == 0x4fe00000)
-		rt5514_spi_burst_read(payload_addr, (u8 *)&rt5514->payload.data,
-			AMBIENT_COMMON_MAX_PAYLOAD_BUFFER_SIZE);
+	payload_addr = vals[0];
+	rt5514->payload.size = vals[1];
+	rt5514->payload.status = vals[2];
+
+	if (rt5514->dsp && (payload_addr & 0xffe00000) == 0x4fe00000)
+		rt5514_spi_burst_read(rt5514->dsp, payload_addr, (u8 *)&rt5514->payload.data,
+			AMBIENT_COMMON_MAX_PAYLOAD_BUFFER_SIZE,
+			RT5514_SPI_CLASS_CTRL, NULL);
 
 	return ret;
 }
@@ -1213,9 +1375,10 @@ static int rt5514_ambient_process_payload_get(struct snd_kcontrol *kcontrol,
 	regmap_read(rt5514->i2c_regmap, 0x18002fe0, &payload_addr);
 	regmap_read(rt5514->i2c_regmap, 0x18002fe4, &rt5514->payload.size);
 
-	if ((payload_addr & 0xffe00000) == 0x4fe00000)
-		rt5514_spi_burst_read(payload_addr, (u8 *)&rt5514->payload.data,
-			AMBIENT_COMMON_MAX_PAYLOAD_BUFFER_SIZE);
+	if (rt5514->dsp && (payload_addr & 0xffe00000) == 0x4fe00000)
+		rt5514_spi_burst_read(rt5514->dsp, payload_addr, (u8 *)&rt5514->payload.data,
+			AMBIENT_COMMON_MAX_PAYLOAD_BUFFER_SIZE,
+			RT5514_SPI_CLASS_CTRL, NULL);
 
 	if (copy_to_user(bytes, &rt5514->payload, sizeof(RT5514_PAYLOAD))) {
 		dev_warn(component->dev, "%s(), copy_to_user fail\n", __func__);
@@ -1225,20 +1388,61 @@ static int rt5514_ambient_process_payload_get(struct snd_kcontrol *kcontrol,
 	return ret;
 }
 
+#define RT5514_MEM_TEST_BUF_LEN 0x1000
+
+/*
+ * Fill a DSP memory range with a byte value and verify it, reading it back
+ * in RT5514_MEM_TEST_BUF_LEN chunks.
+ */
+static int rt5514_mem_test_range(struct rt5514_priv *rt5514, u8 *buf,
+	unsigned int addr, size_t len, u8 val)
+{
+	struct snd_soc_component *component = rt5514->component;
+	size_t offset, n;
+	u8 *diff;
+	int ret;
+
+	ret = rt5514_spi_fill(rt5514->dsp, addr, val * 0x01010101U, len,
+		RT5514_SPI_CLASS_DBG);
+	if (ret)
+		return ret;
+
+	for (offset = 0; offset < len; offset += n) {
+		n = min_t(size_t, len - offset, RT5514_MEM_TEST_BUF_LEN);
+
+		ret = rt5514_spi_burst_read(rt5514->dsp, addr + offset, buf, n,
+			RT5514_SPI_CLASS_DBG, NULL);
+		if (ret)
+			return ret;
+
+		diff = memchr_inv(buf, val, n);
+		if (diff) {
+			dev_err(component->dev, "[%02x][%02x]", val, *diff);
+			return val - *diff;
+		}
+	}
+
+	return 0;
+}
+
 static int rt5514_mem_test_get(struct snd_kcontrol *kcontrol,
 		struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
 	struct rt5514_priv *rt5514 = snd_soc_component_get_drvdata(component);
-	u8 *buf1, *buf2;
+	u8 *buf;
 	int ret;
 
 	if (!rt5514->v_p)
 		return 0;
 
-	if (!rt5514->dsp_test)
+	if (!rt5514->dsp_test || !rt5514->dsp)
 		return 0;
 
+	buf = kmalloc(RT5514_MEM_TEST_BUF_LEN, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
 	if (rt5514->gpiod_reset) {
 		gpiod_set_value(rt5514->gpiod_reset, 0);
 		usleep_range(1000, 2000);
@@ -1250,38 +1454,23 @@ static int rt5514_mem_test_get(struct snd_kcontrol *kcontrol,
 
 	rt5514_enable_dsp_prepare(rt5514);
 
-	buf1 = kmalloc(0xb8000, GFP_KERNEL);
-	buf2 = kmalloc(0xb8000, GFP_KERNEL);
-
 	dev_info(component->dev, "Test 1 IMEM 0\n");
-	memset(buf1, 0, 0x18000);
-	rt5514_spi_burst_write(0x4ff00000, buf1, 0x18000);
-	rt5514_spi_burst_read(0x4ff00000, buf2, 0x18000);
-	ret = rt5514_memcmp(rt5514, buf1, buf2, 0x18000);
+	ret = rt5514_mem_test_range(rt5514, buf, 0x4ff00000, 0x18000, 0);
 	if (ret)
 		goto failed;
 
 	dev_info(component->dev, "Test 2 IMEM 1\n");
-	memset(buf1, 0xff, 0x18000);
-	rt5514_spi_burst_write(0x4ff00000, buf1, 0x18000);
-	rt5514_spi_burst_read(0x4ff00000, buf2, 0x18000);
-	ret = rt5514_memcmp(rt5514, buf1, buf2, 0x18000);
+	ret = rt5514_mem_test_range(rt5514, buf, 0x4ff00000, 0x18000, 0xff);
 	if (ret)
 		goto failed;
 
 	dev_info(component->dev, "Test 3 DMEM 0\n");
-	memset(buf1, 0, 0xb8000);
-	rt5514_spi_burst_write(0x4fe00000, buf1, 0xb8000);
-	rt5514_spi_burst_read(0x4fe00000, buf2, 0xb8000);
-	ret = rt5514_memcmp(rt5514, buf1, buf2, 0xb8000);
+	ret = rt5514_mem_test_range(rt5514, buf, 0x4fe00000, 0xb8000, 0);
 	if (ret)
 		goto failed;
 
 	dev_info(component->dev, "Test 4 DMEM 1\n");
-	memset(buf1, 0xff, 0xb8000);
-	rt5514_spi_burst_write(0x4fe00000, buf1, 0xb8000);
-	rt5514_spi_burst_read(0x4fe00000, buf2, 0xb8000);
-	ret = rt5514_memcmp(rt5514, buf1, buf2, 0xb8000);
+	ret = rt5514_mem_test_range(rt5514, buf, 0x4fe00000, 0xb8000, 0xff);
 
 	dev_info(component->dev, "Test done\n");
 
@@ -1296,13 +1485,15 @@ failed:
 			rt5514_i2c_patch, ARRAY_SIZE(rt5514_i2c_patch));
 	}
 
-	rt5514_dsp_enable(rt5514, false, true);
 	ucontrol->value.integer.value[0] = ret;
 
-	kfree(buf1);
-	kfree(buf2);
+	ret = rt5514_dsp_enable(rt5514, false, true);
+	if (ret)
+		dev_err(component->dev, "DSP enable failed %d\n", ret);
 
-	return 0;
+	kfree(buf);
+
+	return ret;
 }
 
 static int rt5514_ambient_hotword_version_get(struct snd_kcontrol *kcontrol,
@@ -1313,7 +1504,7 @@ static int rt5514_ambient_hotword_version_get(struct snd_kcontrol *kcontrol,
 	unsigned int version;
 
 	regmap_write(rt5514->i2c_regmap, 0x18002fd0, 0x1 << 28);
-	regmap_write(rt5514->i2c_regmap, 0x18001014, 2);
+	regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 2);
 
 	msleep(20);
 
@@ -1340,9 +1531,10 @@ static int rt5514_firmware_version_get(struct snd_kcontrol *kcontrol,
 			dsp_fw_ver.version, dsp_fw_ver.sub_version);
 	}
 
-	if (rt5514->dsp_enabled | rt5514->dsp_adc_enabled) {
-		rt5514_spi_burst_read(rt5514->fw_addr[0] + 0x128,
-			(u8 *)&dsp_mem, sizeof(RT5514_DSP_MEM));
+	if ((rt5514->dsp_enabled | rt5514->dsp_adc_enabled) && rt5514->dsp) {
+		rt5514_spi_burst_read(rt5514->dsp, rt5514->fw_addr[0] + 0x128,
+			(u8 *)&dsp_mem, sizeof(RT5514_DSP_MEM),
+			RT5514_SPI_CLASS_CTRL, NULL);
 		dev_info(component->dev, "IRAM: %d DRAM: %d\n",
 			dsp_mem.iram, dsp_mem.dram);
 	}
@@ -1363,15 +1555,15 @@ static int rt5514_hotword_dsp_identifier_get(struct snd_kcontrol *kcontrol,
 		return -EINVAL;
 
 	regmap_write(rt5514->i2c_regmap, 0x18002fd0, 0x2 << 28);
-	regmap_write(rt5514->i2c_regmap, 0x18001014, 2);
+	regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 2);
 
 	msleep(20);
 
 	regmap_read(rt5514->i2c_regmap, 0x18002fd4, &identifier_addr);
 
-	if ((identifier_addr & 0xffe00000) == 0x4fe00000)
-		rt5514_spi_burst_read(identifier_addr, (u8 *)&uuid,
-			DSP_IDENTIFIER_SIZE);
+	if (rt5514->dsp && (identifier_addr & 0xffe00000) == 0x4fe00000)
+		rt5514_spi_burst_read(rt5514->dsp, identifier_addr, (u8 *)&uuid,
+			DSP_IDENTIFIER_SIZE, RT5514_SPI_CLASS_CTRL, NULL);
 
 	if (copy_to_user(bytes, &uuid, DSP_IDENTIFIER_SIZE)) {
 		dev_warn(component->dev, "%s(), copy_to_user fail\n", __func__);
@@ -1805,14 +1997,14 @@ static int rt5514_hw_params(struct snd_pcm_substream *substream,
 			rt5514->pcm_rate = SNDRV_PCM_RATE_48000;
 
 			if (rt5514->dsp_adc_enabled) {
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_WOV_I2S_SENSOR);
 			} else {
 				if (rt5514->dsp_model)
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_WOV_I2S);
 				else
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_I2S);
 			}
 			break;
@@ -1821,14 +2013,14 @@ static int rt5514_hw_params(struct snd_pcm_substream *substream,
 			rt5514->pcm_rate = SNDRV_PCM_RATE_96000;
 
 			if (rt5514->dsp_adc_enabled) {
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_WOV_I2S_96k_SENSOR);
 			} else {
 				if (rt5514->dsp_model)
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_WOV_I2S_96k);
 				else
-					regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+					regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 						RT5514_DSP_FUNC_I2S_96k);
 			}
 			break;
@@ -1837,7 +2029,7 @@ static int rt5514_hw_params(struct snd_pcm_substream *substream,
 			return -EINVAL;
 		}
 
-		regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+		regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 
 		return 0;
 	}
@@ -1902,18 +2094,18 @@ static int rt5514_hw_free(struct snd_pcm_substream  *substream,
 
 	if (rt5514->dsp_enabled | rt5514->dsp_adc_enabled) {
 		if (rt5514->dsp_adc_enabled) {
-			regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+			regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 				RT5514_DSP_FUNC_WOV_SENSOR);
 		} else {
 			if (rt5514->dsp_model)
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_WOV);
 			else
-				regmap_write(rt5514->i2c_regmap, RT5514_DSP_FUNC,
+				regmap_write(rt5514_dsp_regmap(rt5514), RT5514_DSP_FUNC,
 					RT5514_DSP_FUNC_SUSPEND);
 		}
 
-		regmap_write(rt5514->i2c_regmap, 0x18001014, 1);
+		regmap_write(rt5514_dsp_regmap(rt5514), 0x18001014, 1);
 
 		return 0;
 	}
@@ -2363,8 +2555,12 @@ static int rt5514_i2c_probe(struct i2c_client *i2c,
 		return ret;
 	}
 
-	rt5514_g_i2c_regmap = rt5514->i2c_regmap;
-	g_rt5514 = rt5514;
+#if IS_ENABLED(CONFIG_SND_SOC_RT5514_SPI)
+	/* NULL when the board has no SPI companion, the DSP then uses I2C */
+	rt5514->dsp = rt5514_spi_get_dsp(&i2c->dev, rt5514);
+	if (IS_ERR(rt5514->dsp))
+		return PTR_ERR(rt5514->dsp);
+#endif
 
 	rt5514->regmap = devm_regmap_init(&i2c->dev, NULL, i2c, &rt5514_regmap);
 	if (IS_ERR(rt5514->regmap)) {
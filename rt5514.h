@@ -316,6 +316,8 @@ typedef struct _dsp_mem_st {
 	unsigned int dram;
 } RT5514_DSP_MEM;
 
+struct rt5514_dsp;
+
 struct rt5514_priv {
 	struct rt5514_platform_data pdata;
 	struct snd_soc_component *component;
@@ -341,10 +343,10 @@ struct rt5514_priv {
 	unsigned int fw_addr[10];
 	bool is_streaming;
 	bool load_default_sound_model;
+	struct rt5514_dsp *dsp;
 };
 
-int rt5514_set_gpio(int gpio, bool output);
-void rt5514_watchdog_handler(void);
-extern struct regmap *rt5514_g_i2c_regmap;
+int rt5514_set_gpio(struct device *dev, int gpio, bool output);
+int rt5514_watchdog_handler(struct rt5514_priv *rt5514);
 
 #endif /* __RT5514_H__ */